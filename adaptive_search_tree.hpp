@@ -0,0 +1,199 @@
+// This is a search tree that picks its engine by how it is used. It
+// counts the reads and writes made on it, and once every window of
+// operations, compares how many reads there were per write. A tree
+// that is mostly read is flattened into a FlatSearchTree, and a flat
+// tree that starts being written is moved back into the nodes of a
+// BinarySearchTree. The two thresholds are kept apart, so a ratio
+// that wavers between them does not keep moving the tree.
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+#include "binary_search_tree.hpp"
+#include "flat_search_tree.hpp"
+
+template<typename KeyType, typename ValueType>
+class AdaptiveSearchTree
+{
+public:
+    using NodeTree       = BinarySearchTree<KeyType, ValueType>;
+    using FlatTree       = FlatSearchTree<KeyType, ValueType>;
+    using SizeType       = std::size_t;
+    using Pair           = std::pair<KeyType, ValueType>;
+    using ConstPointer   = const Pair*;
+    using ConstReference = const Pair&;
+
+    // the number of operations between checks of the read ratio
+    static constexpr std::uint64_t WINDOW = 1024;
+
+private:
+    NodeTree m_Nodes;
+    FlatTree m_Flat;
+    bool m_IsFlat;
+
+    // reads per write at or above which the tree is flattened, and
+    // below which a flat tree goes back to nodes
+    double m_FlatRatio;
+    double m_NodeRatio;
+
+    // the operations counted in the current window
+    std::uint64_t m_Reads;
+    std::uint64_t m_Writes;
+
+public:
+    /**
+     * @brief Default constructor.
+     * @param flatRatio The reads per write to flatten the tree at.
+     * @param nodeRatio The reads per write to go back to nodes below,
+     *                  which must be less than flatRatio.
+     * 
+     * Creates an empty tree of nodes.
+     */
+    explicit AdaptiveSearchTree(double flatRatio = 64, double nodeRatio = 8)
+        : m_IsFlat(false),
+          m_FlatRatio(flatRatio),
+          m_NodeRatio(nodeRatio),
+          m_Reads(0),
+          m_Writes(0)
+    { }
+
+    SizeType Size() const { return m_IsFlat ? m_Flat.Size() : m_Nodes.Size(); }
+    bool Empty() const { return Size() == 0; }
+
+    // get whether the tree is currently flat
+    bool IsFlat() const { return m_IsFlat; }
+
+    // change the reads per write that the tree moves at
+    void SetRatios(double flatRatio, double nodeRatio)
+    {
+        m_FlatRatio = flatRatio;
+        m_NodeRatio = nodeRatio;
+    }
+
+    ConstReference Min() const { return m_IsFlat ? m_Flat.Min() : m_Nodes.Min(); }
+    ConstReference Max() const { return m_IsFlat ? m_Flat.Max() : m_Nodes.Max(); }
+
+    // find pairs in the tree, which counts as a read, unless the tree
+    // is const, so that const readers do not share the counters
+    bool Contains(const KeyType& key)
+    {
+        Count(1, 0);
+        return m_IsFlat ? m_Flat.Contains(key) : m_Nodes.Contains(key);
+    }
+
+    bool Contains(const KeyType& key) const { return m_IsFlat ? m_Flat.Contains(key) : m_Nodes.Contains(key); }
+
+    ValueType& Find(const KeyType& key)
+    {
+        Count(1, 0);
+        return m_IsFlat ? m_Flat.Find(key) : m_Nodes.Find(key);
+    }
+
+    const ValueType& Find(const KeyType& key) const { return m_IsFlat ? m_Flat.Find(key) : m_Nodes.Find(key); }
+
+    ConstPointer Predecessor(const KeyType& key)
+    {
+        Count(1, 0);
+        return m_IsFlat ? m_Flat.Predecessor(key) : m_Nodes.Predecessor(key);
+    }
+
+    ConstPointer Predecessor(const KeyType& key) const { return m_IsFlat ? m_Flat.Predecessor(key) : m_Nodes.Predecessor(key); }
+
+    ConstPointer Successor(const KeyType& key)
+    {
+        Count(1, 0);
+        return m_IsFlat ? m_Flat.Successor(key) : m_Nodes.Successor(key);
+    }
+
+    ConstPointer Successor(const KeyType& key) const { return m_IsFlat ? m_Flat.Successor(key) : m_Nodes.Successor(key); }
+
+    // delete all the pairs in the tree
+    void Clear()
+    {
+        m_Flat.Clear();
+        m_Nodes.Clear();
+    }
+
+    // change the tree, which counts as a write
+    void Insert(ConstReference data)
+    {
+        Count(0, 1);
+        if (m_IsFlat) m_Flat.Insert(data);
+        else m_Nodes.Insert(data);
+    }
+
+    void Insert(Pair&& data)
+    {
+        Count(0, 1);
+        if (m_IsFlat) m_Flat.Insert( std::move(data) );
+        else m_Nodes.Insert( std::move(data) );
+    }
+
+    void Erase(const KeyType& key)
+    {
+        Count(0, 1);
+        if (m_IsFlat) m_Flat.Erase(key);
+        else m_Nodes.Erase(key);
+    }
+
+    Pair PopMin()
+    {
+        Count(0, 1);
+        return m_IsFlat ? m_Flat.PopMin() : m_Nodes.PopMin();
+    }
+
+    Pair PopMax()
+    {
+        Count(0, 1);
+        return m_IsFlat ? m_Flat.PopMax() : m_Nodes.PopMax();
+    }
+
+private:
+    /**
+     * @brief Counts operations, and moves the tree when a window ends.
+     * @param reads The reads to count.
+     * @param writes The writes to count.
+     * 
+     * Moving the tree takes O(n log n), once per window at most.
+     */
+    void Count(std::uint64_t reads, std::uint64_t writes)
+    {
+        m_Reads += reads;
+        m_Writes += writes;
+        if (m_Reads + m_Writes < WINDOW) return;
+
+        // a window without writes is as read-mostly as it gets
+        double ratio = m_Writes > 0 ? static_cast<double>(m_Reads) / m_Writes : m_FlatRatio;
+
+        if ( !m_IsFlat && !(ratio < m_FlatRatio) ) Flatten();
+        else if ( m_IsFlat && ratio < m_NodeRatio ) Unflatten();
+
+        m_Reads = 0;
+        m_Writes = 0;
+    }
+
+    // move the nodes into a flat tree, in order
+    void Flatten()
+    {
+        std::vector<Pair> pairs;
+        pairs.reserve( m_Nodes.Size() );
+        while ( !m_Nodes.Empty() )
+            pairs.push_back( m_Nodes.PopMin() );
+
+        m_Flat = FlatTree( std::move(pairs) );
+        m_Nodes = NodeTree();
+        m_IsFlat = true;
+    }
+
+    // build the flat pairs into a balanced tree of nodes
+    void Unflatten()
+    {
+        m_Nodes.BuildOptimal( m_Flat.TakePairs(), std::vector<double>() );
+        m_Flat.Clear();
+        m_IsFlat = false;
+    }
+};
@@ -0,0 +1,94 @@
+// This benchmarks a filtering pass over the tree, which erases every
+// entry that fails a predicate. The pass is made once with a cursor,
+// which steps through the tree in order, and once with Erase, which
+// descends from the root for every key. Both passes must leave trees
+// of the same height, and the program fails if they do not.
+//
+// Build and run from this directory:
+//
+//     g++ -O2 -std=c++17 -I.. cursor_filter.cpp -o cursor_filter
+//     ./cursor_filter [entries]
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+#include "binary_search_tree.hpp"
+
+using Tree = BinarySearchTree<std::uint64_t, std::uint64_t>;
+
+// time a pass, and return the milliseconds it took
+template<typename Function>
+double Time(Function run)
+{
+    using Clock = std::chrono::steady_clock;
+
+    Clock::time_point start = Clock::now();
+    run();
+    return std::chrono::duration<double, std::milli>( Clock::now() - start ).count();
+}
+
+/**
+ * @brief Filters a tree both ways.
+ * @param name The name of the filter.
+ * @param tree The tree to filter, which is left unchanged.
+ * @param erase Whether a key is erased.
+ * @return Whether both passes left trees of the same size and height.
+ */
+template<typename Predicate>
+bool Filter(const char* name, const Tree& tree, Predicate erase)
+{
+    Tree cursorTree(tree);
+    Tree eraseTree(tree);
+
+    double cursorTime = Time([&]
+    {
+        Tree::Cursor cursor = cursorTree.CursorAtMin();
+        while ( cursor.Valid() )
+        {
+            if ( erase(cursor.Data().first) ) cursor.EraseHere();
+            else cursor.Next();
+        }
+    });
+
+    std::vector<std::uint64_t> keys;
+    tree.ForEach([&](const Tree::Pair& pair) { if ( erase(pair.first) ) keys.push_back(pair.first); });
+
+    double eraseTime = Time([&]
+    {
+        for (std::uint64_t key : keys)
+            eraseTree.Erase(key);
+    });
+
+    std::printf( "%-14s %10.1f %10.1f %10zu %10zu %10zu\n", name, cursorTime, eraseTime,
+                 cursorTree.Size(), cursorTree.Height(), eraseTree.Height() );
+
+    return cursorTree.Size() == eraseTree.Size() && cursorTree.Height() == eraseTree.Height();
+}
+
+int main(int argc, char** argv)
+{
+    std::size_t entries = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 1000000;
+
+    std::vector<Tree::Pair> pairs(entries);
+    for (std::size_t i = 0; i < entries; ++i)
+        pairs[i] = Tree::Pair(i, i);
+
+    // a balanced tree, since sorted inserts would make a list
+    Tree tree;
+    tree.BuildOptimal(pairs, {});
+
+    std::printf("%zu entries, height %zu\n", tree.Size(), tree.Height());
+    std::printf( "%-14s %10s %10s %10s %10s %10s\n", "filter", "cursor ms", "erase ms",
+                 "left", "cursor h", "erase h" );
+
+    bool same = true;
+    same &= Filter("odd keys", tree, [](std::uint64_t key) { return key % 2 == 1; });
+    same &= Filter("3 of every 4", tree, [](std::uint64_t key) { return key % 4 != 0; });
+    same &= Filter("all", tree, [](std::uint64_t) { return true; });
+
+    if (!same) std::printf("the cursor left a different tree than Erase\n");
+    return same ? 0 : 1;
+}
@@ -0,0 +1,132 @@
+// This benchmarks the operations of the binary search tree with
+// hardware performance counters, and reports each counter per
+// operation next to the wall time. Counters that are not allowed,
+// such as inside most containers, are reported as n/a.
+//
+// Build and run from this directory:
+//
+//     g++ -O2 -std=c++17 -I.. hardware_counters.cpp -o hardware_counters
+//     ./hardware_counters [entries]
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <vector>
+
+#include "binary_search_tree.hpp"
+#include "perf_counters.hpp"
+
+using Tree = BinarySearchTree<std::uint64_t, std::uint64_t>;
+
+// keeps lookups from being optimized away
+static volatile std::uint64_t g_Sink;
+
+/**
+ * @brief Measures an operation.
+ * @param counters The counters to read.
+ * @param name The name of the operation.
+ * @param operations The number of operations performed by run.
+ * @param run The operations to measure.
+ * 
+ * Prints the wall time and every counter, per operation.
+ */
+template<typename Function>
+void Measure(PerfCounters& counters, const char* name, std::size_t operations, Function run)
+{
+    using Clock = std::chrono::steady_clock;
+
+    counters.Start();
+    Clock::time_point start = Clock::now();
+    run();
+    double nanoseconds = std::chrono::duration<double, std::nano>( Clock::now() - start ).count();
+    PerfCounters::Reading reading = counters.Stop();
+
+    std::printf("%-14s %10.1f", name, nanoseconds / operations);
+    for (std::size_t i = 0; i < PerfCounters::COUNTER_COUNT; ++i)
+    {
+        if (reading.values[i] < 0) std::printf(" %14s", "n/a");
+        else std::printf(" %14.2f", reading.values[i] / operations);
+    }
+    std::printf("\n");
+}
+
+int main(int argc, char** argv)
+{
+    std::size_t entries = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 1000000;
+
+    std::vector<std::uint64_t> keys(entries);
+    for (std::size_t i = 0; i < entries; ++i)
+        keys[i] = 2 * i;
+
+    std::mt19937_64 random(42);
+    std::shuffle(keys.begin(), keys.end(), random);
+
+    std::vector<std::uint64_t> lookups = keys;
+    std::shuffle(lookups.begin(), lookups.end(), random);
+
+    PerfCounters counters;
+    if ( !counters.Available() )
+        std::printf("hardware counters are unavailable, reporting wall time only\n");
+
+    std::printf("%-14s %10s", "operation", "ns/op");
+    for (std::size_t i = 0; i < PerfCounters::COUNTER_COUNT; ++i)
+        std::printf( " %14s", PerfCounters::Name( static_cast<PerfCounters::Counter>(i) ) );
+    std::printf("\n");
+
+    Tree tree;
+
+    Measure(counters, "insert", entries, [&]
+    {
+        for (std::uint64_t key : keys)
+            tree.Insert( Tree::Pair(key, key) );
+    });
+
+    Measure(counters, "find hit", entries, [&]
+    {
+        std::uint64_t sum = 0;
+        for (std::uint64_t key : lookups)
+            sum += tree.Find(key);
+        g_Sink = sum;
+    });
+
+    Measure(counters, "find miss", entries, [&]
+    {
+        std::size_t found = 0;
+        for (std::uint64_t key : lookups)
+            found += tree.Contains(key + 1);
+        g_Sink = found;
+    });
+
+    Measure(counters, "shrink", 1, [&] { tree.Shrink(); });
+
+    Measure(counters, "find shrunk", entries, [&]
+    {
+        std::uint64_t sum = 0;
+        for (std::uint64_t key : lookups)
+            sum += tree.Find(key);
+        g_Sink = sum;
+    });
+
+    Measure(counters, "copy", 1, [&]
+    {
+        Tree copy(tree);
+        g_Sink = copy.Size();
+    });
+
+    Measure(counters, "erase", entries / 2, [&]
+    {
+        for (std::size_t i = 0; i < entries / 2; ++i)
+            tree.Erase(lookups[i]);
+    });
+
+    Measure(counters, "pop min", tree.Size(), [&]
+    {
+        while ( !tree.Empty() )
+            g_Sink = tree.PopMin().first;
+    });
+
+    return 0;
+}
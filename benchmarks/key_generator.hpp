@@ -0,0 +1,159 @@
+// These generate the keys of a benchmark workload, in the style of
+// YCSB. Records are numbered in the order they were inserted, and a
+// generator picks record numbers from a uniform, Zipfian, latest or
+// sequential distribution. Record numbers are scrambled into keys, so
+// that inserting them in order still builds a bushy tree.
+
+#pragma once
+
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <random>
+
+/**
+ * @brief Turns a record number into a key.
+ * @param record The record number.
+ * @return The record's key.
+ *
+ * Mixes the bits with the SplitMix64 finalizer, which is a bijection,
+ * so no two records share a key.
+ */
+inline std::uint64_t RecordKey(std::uint64_t record)
+{
+    record ^= record >> 30;
+    record *= 0xbf58476d1ce4e5b9ULL;
+    record ^= record >> 27;
+    record *= 0x94d049bb133111ebULL;
+    record ^= record >> 31;
+    return record;
+}
+
+// This draws numbers from 0 to items - 1, where the probability of
+// the number i is proportional to 1 / (i + 1)^theta. It is the method
+// of Gray et al., "Quickly Generating Billion-Record Synthetic
+// Databases", which YCSB uses too.
+class ZipfianGenerator
+{
+    std::uint64_t m_Items;
+    double m_Theta;
+    double m_Alpha;
+    double m_Zeta;
+    double m_Eta;
+    double m_HalfPowTheta;
+
+public:
+    explicit ZipfianGenerator(std::uint64_t items, double theta = 0.99)
+        : m_Items(items),
+          m_Theta(theta),
+          m_Alpha( 1.0 / (1.0 - theta) ),
+          m_Zeta( Zeta(items, theta) ),
+          m_Eta(0),
+          m_HalfPowTheta( 1.0 + std::pow(0.5, theta) )
+    {
+        m_Eta = ( 1.0 - std::pow(2.0 / items, 1.0 - theta) ) / ( 1.0 - Zeta(2, theta) / m_Zeta );
+    }
+
+    std::uint64_t Items() const { return m_Items; }
+
+    // draw a number, where smaller numbers are more popular
+    template<typename Random>
+    std::uint64_t operator()(Random& random) const
+    {
+        double u = std::uniform_real_distribution<double>(0.0, 1.0)(random);
+        double uz = u * m_Zeta;
+
+        if (uz < 1.0) return 0;
+        if (uz < m_HalfPowTheta) return 1 < m_Items ? 1 : 0;
+
+        std::uint64_t item = static_cast<std::uint64_t>( m_Items * std::pow(m_Eta * u - m_Eta + 1.0, m_Alpha) );
+        return item < m_Items ? item : m_Items - 1;
+    }
+
+private:
+    // sum 1 / i^theta, for i from 1 to items
+    static double Zeta(std::uint64_t items, double theta)
+    {
+        double sum = 0;
+        for (std::uint64_t i = 1; i <= items; ++i)
+            sum += 1.0 / std::pow( static_cast<double>(i), theta );
+        return sum;
+    }
+};
+
+enum class KeyDistribution
+{
+    Uniform,
+    Zipfian,
+    Latest,
+    Sequential
+};
+
+// This picks the records that a thread reads, updates and erases.
+// Records are counted by a shared counter, which inserts advance.
+class KeyGenerator
+{
+    KeyDistribution m_Distribution;
+    const ZipfianGenerator& m_Zipfian;
+    const std::atomic<std::uint64_t>& m_Records;
+    std::mt19937_64 m_Random;
+    std::uint64_t m_Next;
+
+public:
+    /**
+     * @brief Default constructor.
+     * @param distribution How records are picked.
+     * @param zipfian The popularity of records, for Zipfian and latest.
+     * @param records The number of records inserted so far.
+     * @param seed The seed of this generator's random numbers.
+     */
+    KeyGenerator(KeyDistribution distribution, const ZipfianGenerator& zipfian,
+                 const std::atomic<std::uint64_t>& records, std::uint64_t seed)
+        : m_Distribution(distribution),
+          m_Zipfian(zipfian),
+          m_Records(records),
+          m_Random(seed),
+          m_Next(seed)
+    { }
+
+    // draw a random number from the generator's source
+    std::mt19937_64& Random() { return m_Random; }
+
+    /**
+     * @brief Picks an inserted record.
+     * @return The key of the record.
+     *
+     * Zipfian picks favor the first records, and latest picks favor
+     * the most recently inserted ones. Sequential picks go through the
+     * records in order, starting from the seed.
+     */
+    std::uint64_t Next()
+    {
+        std::uint64_t records = m_Records.load(std::memory_order_relaxed);
+        std::uint64_t record = 0;
+
+        switch (m_Distribution)
+        {
+        case KeyDistribution::Uniform:
+            record = std::uniform_int_distribution<std::uint64_t>(0, records - 1)(m_Random);
+            break;
+
+        // records inserted after the generator was made are never popular
+        case KeyDistribution::Zipfian:
+            record = m_Zipfian(m_Random);
+            if ( !(record < records) ) record = records - 1;
+            break;
+
+        case KeyDistribution::Latest:
+            record = m_Zipfian(m_Random);
+            record = record < records ? records - 1 - record : 0;
+            break;
+
+        case KeyDistribution::Sequential:
+            record = m_Next++ % records;
+            break;
+        }
+
+        return RecordKey(record);
+    }
+};
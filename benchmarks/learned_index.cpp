@@ -0,0 +1,155 @@
+// This benchmarks a learned index over a frozen snapshot of the tree
+// against the tree itself, and against a binary search of the same
+// sorted keys. Point lookups only ask for keys that are present, and
+// lower bound queries ask for random keys. Each is run over uniform
+// keys and over clustered keys, which need more segments to fit.
+//
+// Build and run from this directory:
+//
+//     g++ -O2 -std=c++17 -I.. learned_index.cpp -o learned_index
+//     ./learned_index [entries] [epsilon]
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <vector>
+
+#include "binary_search_tree.hpp"
+#include "key_generator.hpp"
+#include "learned_index.hpp"
+
+using Tree = BinarySearchTree<std::uint64_t, std::uint64_t>;
+using Index = LearnedIndex<std::uint64_t, std::uint64_t>;
+
+// keeps lookups from being optimized away
+static volatile std::uint64_t g_Sink;
+
+// time some queries, and print the nanoseconds per query
+template<typename Function>
+void Measure(const char* name, std::size_t queries, Function run)
+{
+    using Clock = std::chrono::steady_clock;
+
+    Clock::time_point start = Clock::now();
+    run();
+    double nanoseconds = std::chrono::duration<double, std::nano>( Clock::now() - start ).count();
+
+    std::printf("  %-24s %10.1f ns/op\n", name, nanoseconds / queries);
+}
+
+/**
+ * @brief Benchmarks one set of keys.
+ * @param name The name of the key set.
+ * @param keys The keys, in random order.
+ * @param epsilon The error bound of the learned index.
+ * @param random The source of the queries.
+ * 
+ * Inserts the keys into a tree, takes a snapshot of it, and runs the
+ * same queries against the tree, the sorted keys and the snapshot.
+ */
+void Run(const char* name, const std::vector<std::uint64_t>& keys, std::size_t epsilon, std::mt19937_64& random)
+{
+    Tree tree;
+    for (std::uint64_t key : keys)
+        tree.Insert( Tree::Pair(key, key) );
+
+    Index index(epsilon);
+    index.Build(tree);
+
+    std::vector<std::uint64_t> sorted(keys);
+    std::sort( sorted.begin(), sorted.end() );
+
+    std::vector<std::uint64_t> hits(keys);
+    std::shuffle(hits.begin(), hits.end(), random);
+
+    std::vector<std::uint64_t> probes( keys.size() );
+    std::uniform_int_distribution<std::uint64_t> spread( sorted.front(), sorted.back() );
+    for (std::uint64_t& probe : probes)
+        probe = spread(random);
+
+    std::printf( "%s: %zu keys, %zu segments, %zu levels, %zu index bytes\n",
+                 name, index.Size(), index.Segments(), index.Levels(), index.IndexBytes() );
+
+    Measure("tree find", hits.size(), [&]
+    {
+        std::uint64_t sum = 0;
+        for (std::uint64_t key : hits)
+            sum += tree.Find(key);
+        g_Sink = sum;
+    });
+
+    Measure("binary search find", hits.size(), [&]
+    {
+        std::uint64_t sum = 0;
+        for (std::uint64_t key : hits)
+            sum += *std::lower_bound(sorted.begin(), sorted.end(), key);
+        g_Sink = sum;
+    });
+
+    Measure("learned find", hits.size(), [&]
+    {
+        std::uint64_t sum = 0;
+        for (std::uint64_t key : hits)
+            sum += index.Find(key);
+        g_Sink = sum;
+    });
+
+    Measure("tree lower bound", probes.size(), [&]
+    {
+        std::uint64_t sum = 0;
+        for (std::uint64_t key : probes)
+        {
+            const Tree::Pair* next = tree.Successor(key);
+            if (next) sum += next->first;
+        }
+        g_Sink = sum;
+    });
+
+    Measure("binary search lower bound", probes.size(), [&]
+    {
+        std::uint64_t sum = 0;
+        for (std::uint64_t key : probes)
+            sum += std::lower_bound(sorted.begin(), sorted.end(), key) - sorted.begin();
+        g_Sink = sum;
+    });
+
+    Measure("learned lower bound", probes.size(), [&]
+    {
+        std::uint64_t sum = 0;
+        for (std::uint64_t key : probes)
+            sum += index.LowerBound(key);
+        g_Sink = sum;
+    });
+}
+
+int main(int argc, char** argv)
+{
+    std::size_t entries = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 1000000;
+    std::size_t epsilon = argc > 2 ? std::strtoull(argv[2], nullptr, 10) : 4;
+
+    std::mt19937_64 random(42);
+
+    std::vector<std::uint64_t> uniform(entries);
+    for (std::size_t i = 0; i < entries; ++i)
+        uniform[i] = RecordKey(i);
+    Run("uniform", uniform, epsilon, random);
+
+    // keys are drawn in clusters, which are spaced exponentially apart
+    std::vector<std::uint64_t> clustered;
+    std::exponential_distribution<double> gap(1.0);
+    std::uint64_t base = 0;
+    while (clustered.size() < entries)
+    {
+        base += static_cast<std::uint64_t>( gap(random) * 1e9 ) + 1;
+        for (std::uint64_t i = 0; i < 1000 && clustered.size() < entries; ++i)
+            clustered.push_back( base + i * ( 1 + random() % 16 ) );
+        base = clustered.back() + 1;
+    }
+    std::shuffle(clustered.begin(), clustered.end(), random);
+    Run("clustered", clustered, epsilon, random);
+
+    return 0;
+}
@@ -0,0 +1,207 @@
+// This measures the memory that the binary search tree really uses
+// per entry, next to std::map and a sorted vector of the same pairs.
+// Each structure is built in a child process of its own, so the
+// resident set and heap growth can be read without the others.
+//
+// Three numbers are reported, in bytes per entry:
+//
+//     rss     growth of the resident set, from /proc/self/statm
+//     heap    growth of the bytes malloc has handed out, which
+//             includes the allocator's own headers and padding
+//     ideal   the size of the key and value pair alone
+//
+// The tree is measured as it is built, and again after Shrink has
+// packed its nodes into a single block.
+//
+// Build and run from this directory:
+//
+//     g++ -O2 -std=c++17 -I.. memory_footprint.cpp -o memory_footprint
+//     ./memory_footprint 1000000 10000000 100000000
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <malloc.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "binary_search_tree.hpp"
+#include "key_generator.hpp"
+
+// a value of a given size
+template<std::size_t Bytes>
+struct Payload
+{
+    std::array<char, Bytes> bytes;
+};
+
+// make the key of a record, in the key type
+template<typename KeyType>
+KeyType MakeKey(std::uint64_t record) { return static_cast<KeyType>( RecordKey(record) ); }
+
+template<>
+std::string MakeKey<std::string>(std::uint64_t record) { return "key:" + std::to_string( RecordKey(record) ); }
+
+template<typename ValueType>
+ValueType MakeValue(std::uint64_t record) { return static_cast<ValueType>(record); }
+
+template<>
+Payload<64> MakeValue< Payload<64> >(std::uint64_t) { return Payload<64>(); }
+
+template<>
+Payload<256> MakeValue< Payload<256> >(std::uint64_t) { return Payload<256>(); }
+
+// get the resident set size, in bytes
+std::size_t ResidentBytes()
+{
+    unsigned long pages = 0;
+    unsigned long resident = 0;
+
+    std::FILE* statm = std::fopen("/proc/self/statm", "r");
+    if (statm == nullptr) return 0;
+    if (std::fscanf(statm, "%lu %lu", &pages, &resident) != 2) resident = 0;
+    std::fclose(statm);
+
+    return resident * static_cast<std::size_t>( sysconf(_SC_PAGESIZE) );
+}
+
+// get the bytes handed out by malloc, including its overhead
+std::size_t HeapBytes()
+{
+#if defined(__GLIBC__) && (__GLIBC__ > 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ >= 33))
+    struct mallinfo2 info = mallinfo2();
+    return info.uordblks + info.hblkhd;
+#else
+    return 0;
+#endif
+}
+
+// give freed memory back to the system
+void TrimHeap()
+{
+#if defined(__GLIBC__)
+    malloc_trim(0);
+#endif
+}
+
+/**
+ * @brief Measures a structure in a child process.
+ * @param structure The name of the structure.
+ * @param types The names of the key and value types.
+ * @param entries The number of entries to build it with.
+ * @param ideal The size of one key and value pair.
+ * @param build Builds the structure and keeps it alive while measure
+ *              is called.
+ * 
+ * Prints one row of the report. Nothing is printed when the child
+ * fails, such as when it runs out of memory.
+ */
+template<typename Build>
+void Measure(const char* structure, const char* types, std::size_t entries, std::size_t ideal, Build build)
+{
+    std::fflush(stdout);
+
+    pid_t child = fork();
+    if (child < 0) return;
+
+    if (child == 0)
+    {
+        std::size_t resident = ResidentBytes();
+        std::size_t heap = HeapBytes();
+
+        build([&]
+        {
+            double rss = static_cast<double>( ResidentBytes() - resident ) / entries;
+            double used = static_cast<double>( HeapBytes() - heap ) / entries;
+
+            std::printf("%-14s %-22s %12zu %10.1f %10.1f %10zu\n", structure, types, entries, rss, used, ideal);
+            std::fflush(stdout);
+        });
+
+        std::_Exit(0);
+    }
+
+    int status;
+    waitpid(child, &status, 0);
+}
+
+/**
+ * @brief Measures every structure with one key and value type.
+ * @param types The names of the key and value types.
+ * @param entries The number of entries to build them with.
+ */
+template<typename KeyType, typename ValueType>
+void MeasureTypes(const char* types, std::size_t entries)
+{
+    using Tree = BinarySearchTree<KeyType, ValueType>;
+    using Pair = std::pair<KeyType, ValueType>;
+
+    std::size_t ideal = sizeof(Pair);
+
+    // keys are scrambled, so inserting records in order builds a bushy tree
+    Measure("tree", types, entries, ideal, [&](auto report)
+    {
+        Tree tree;
+        for (std::uint64_t record = 0; record < entries; ++record)
+            tree.Insert( Pair( MakeKey<KeyType>(record), MakeValue<ValueType>(record) ) );
+        report();
+    });
+
+    Measure("tree shrunk", types, entries, ideal, [&](auto report)
+    {
+        Tree tree;
+        for (std::uint64_t record = 0; record < entries; ++record)
+            tree.Insert( Pair( MakeKey<KeyType>(record), MakeValue<ValueType>(record) ) );
+        tree.Shrink();
+        TrimHeap();
+        report();
+    });
+
+    Measure("std::map", types, entries, ideal, [&](auto report)
+    {
+        std::map<KeyType, ValueType> map;
+        for (std::uint64_t record = 0; record < entries; ++record)
+            map.emplace( MakeKey<KeyType>(record), MakeValue<ValueType>(record) );
+        report();
+    });
+
+    // the vector is sized up front, as a frozen table would be
+    Measure("sorted vector", types, entries, ideal, [&](auto report)
+    {
+        std::vector<Pair> pairs;
+        pairs.reserve(entries);
+        for (std::uint64_t record = 0; record < entries; ++record)
+            pairs.emplace_back( MakeKey<KeyType>(record), MakeValue<ValueType>(record) );
+
+        std::sort(pairs.begin(), pairs.end(), [](const Pair& a, const Pair& b) { return a.first < b.first; });
+        report();
+    });
+}
+
+int main(int argc, char** argv)
+{
+    std::vector<std::size_t> sizes;
+    for (int i = 1; i < argc; ++i)
+        sizes.push_back( std::strtoull(argv[i], nullptr, 10) );
+    if ( sizes.empty() ) sizes.push_back(1000000);
+
+    std::printf("%-14s %-22s %12s %10s %10s %10s\n", "structure", "key, value", "entries", "rss", "heap", "ideal");
+
+    for (std::size_t entries : sizes)
+    {
+        MeasureTypes<std::uint32_t, std::uint32_t>("uint32, uint32", entries);
+        MeasureTypes<std::uint64_t, std::uint64_t>("uint64, uint64", entries);
+        MeasureTypes< std::uint64_t, Payload<64> >("uint64, 64 bytes", entries);
+        MeasureTypes< std::uint64_t, Payload<256> >("uint64, 256 bytes", entries);
+        MeasureTypes<std::string, std::uint64_t>("string, uint64", entries);
+    }
+
+    return 0;
+}
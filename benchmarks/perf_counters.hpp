@@ -0,0 +1,190 @@
+// This reads hardware performance counters through the Linux
+// perf_event_open system call. Each counter is opened on its own, so
+// that a counter the machine or container does not allow is simply
+// reported as unavailable, instead of failing the whole group.
+
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+class PerfCounters
+{
+public:
+    using SizeType = std::size_t;
+
+    enum Counter
+    {
+        CYCLES,
+        INSTRUCTIONS,
+        L1D_MISSES,
+        LLC_MISSES,
+        DTLB_MISSES,
+        BRANCH_MISSES,
+        COUNTER_COUNT
+    };
+
+    // the value of each counter, or -1 if it is unavailable
+    struct Reading
+    {
+        double values[COUNTER_COUNT];
+    };
+
+private:
+    int m_Files[COUNTER_COUNT];
+
+public:
+    /**
+     * @brief Default constructor.
+     * 
+     * Opens every counter for the calling thread, in user space only.
+     */
+    PerfCounters()
+    {
+        for (SizeType i = 0; i < COUNTER_COUNT; ++i)
+            m_Files[i] = Open( static_cast<Counter>(i) );
+    }
+
+    PerfCounters(const PerfCounters&) = delete;
+    PerfCounters& operator=(const PerfCounters&) = delete;
+
+    ~PerfCounters()
+    {
+#ifdef __linux__
+        for (int file : m_Files)
+            if (file >= 0) close(file);
+#endif
+    }
+
+    // get the name of a counter
+    static const char* Name(Counter counter)
+    {
+        static const char* const NAMES[COUNTER_COUNT] =
+            { "cycles", "instructions", "L1d-misses", "LLC-misses", "dTLB-misses", "branch-misses" };
+
+        return NAMES[counter];
+    }
+
+    // check whether any counter could be opened
+    bool Available() const
+    {
+        for (int file : m_Files)
+            if (file >= 0) return true;
+
+        return false;
+    }
+
+    bool Available(Counter counter) const { return m_Files[counter] >= 0; }
+
+    // zero and start every counter
+    void Start()
+    {
+#ifdef __linux__
+        for (int file : m_Files)
+        {
+            if (file < 0) continue;
+            ioctl(file, PERF_EVENT_IOC_RESET, 0);
+            ioctl(file, PERF_EVENT_IOC_ENABLE, 0);
+        }
+#endif
+    }
+
+    /**
+     * @brief Stops every counter.
+     * @return The counts since Start.
+     * 
+     * Counts are scaled up when the kernel had to multiplex a counter
+     * and only ran it for part of the time.
+     */
+    Reading Stop()
+    {
+        Reading reading;
+
+        for (SizeType i = 0; i < COUNTER_COUNT; ++i)
+        {
+            reading.values[i] = -1;
+
+#ifdef __linux__
+            if (m_Files[i] < 0) continue;
+            ioctl(m_Files[i], PERF_EVENT_IOC_DISABLE, 0);
+
+            // the value, the time enabled and the time running
+            std::uint64_t data[3];
+            if ( read( m_Files[i], data, sizeof(data) ) != sizeof(data) || data[2] == 0 )
+                continue;
+
+            reading.values[i] = static_cast<double>(data[0]) * data[1] / data[2];
+#endif
+        }
+
+        return reading;
+    }
+
+private:
+    /**
+     * @brief Opens a counter.
+     * @param counter The counter to open.
+     * @return The counter's file descriptor, or -1 if it is unavailable.
+     */
+    static int Open(Counter counter)
+    {
+#ifdef __linux__
+        perf_event_attr attr;
+        std::memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        attr.disabled = 1;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+
+        // cache events are a cache, an operation and a result in one
+        const std::uint64_t READ_MISS = (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                                        (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+
+        switch (counter)
+        {
+        case CYCLES:
+            attr.type = PERF_TYPE_HARDWARE;
+            attr.config = PERF_COUNT_HW_CPU_CYCLES;
+            break;
+
+        case INSTRUCTIONS:
+            attr.type = PERF_TYPE_HARDWARE;
+            attr.config = PERF_COUNT_HW_INSTRUCTIONS;
+            break;
+
+        case L1D_MISSES:
+            attr.type = PERF_TYPE_HW_CACHE;
+            attr.config = PERF_COUNT_HW_CACHE_L1D | READ_MISS;
+            break;
+
+        case LLC_MISSES:
+            attr.type = PERF_TYPE_HW_CACHE;
+            attr.config = PERF_COUNT_HW_CACHE_LL | READ_MISS;
+            break;
+
+        case DTLB_MISSES:
+            attr.type = PERF_TYPE_HW_CACHE;
+            attr.config = PERF_COUNT_HW_CACHE_DTLB | READ_MISS;
+            break;
+
+        default:
+            attr.type = PERF_TYPE_HARDWARE;
+            attr.config = PERF_COUNT_HW_BRANCH_MISSES;
+            break;
+        }
+
+        return static_cast<int>( syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0) );
+#else
+        (void)counter;
+        return -1;
+#endif
+    }
+};
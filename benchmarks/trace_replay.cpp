@@ -0,0 +1,160 @@
+// This replays a binary trace, written by a TraceRecorder, against
+// the binary search tree, and reports the throughput and latency of
+// each operation. Traces are replayed as fast as possible, or paced
+// to the recorded times. A trace can also be printed as text, which
+// the workload driver replays too.
+//
+// Only traces of integer keys are read, since the tree is rebuilt
+// with 64-bit keys and values.
+//
+// Build and run from this directory:
+//
+//     g++ -O2 -std=c++17 -I.. trace_replay.cpp -o trace_replay
+//     ./trace_replay production.bsttrace
+//     ./trace_replay --paced production.bsttrace
+//     ./trace_replay --text production.bsttrace > production.trace
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <thread>
+
+#include "binary_search_tree.hpp"
+#include "trace_recorder.hpp"
+
+using Tree = BinarySearchTree<std::uint64_t, std::uint64_t>;
+using Record = TraceRecord<std::uint64_t>;
+
+static constexpr std::size_t OPERATION_COUNT = Tree::OPERATION_COUNT;
+static const char* const OPERATION_NAMES[OPERATION_COUNT] = { "insert", "find", "erase", "copy", "clear" };
+
+// keeps lookups from being optimized away
+static volatile std::uint64_t g_Sink;
+
+/**
+ * @brief Prints a trace as text.
+ * @param reader The trace to print.
+ * 
+ * Finds are printed as reads. Copies and clears have no text form,
+ * so they are printed as comments.
+ */
+void PrintText(TraceReader<std::uint64_t>& reader)
+{
+    Record record;
+
+    while ( reader.Next(record) )
+    {
+        Tree::Operation operation = static_cast<Tree::Operation>(record.operation);
+        unsigned long long key = record.key;
+
+        switch (operation)
+        {
+        case Tree::Operation::Insert: std::printf("insert %llu\n", key); break;
+        case Tree::Operation::Find: std::printf("read %llu\n", key); break;
+        case Tree::Operation::Erase: std::printf("erase %llu\n", key); break;
+        default: std::printf("# %s\n", record.operation < OPERATION_COUNT ? OPERATION_NAMES[record.operation] : "unknown");
+        }
+    }
+}
+
+/**
+ * @brief Replays a trace.
+ * @param reader The trace to replay.
+ * @param paced Whether to wait for the recorded time of each operation.
+ * 
+ * Performs every operation on a tree, timing each one, and prints the
+ * throughput and latency quantiles.
+ */
+void Replay(TraceReader<std::uint64_t>& reader, bool paced)
+{
+    using Clock = std::chrono::steady_clock;
+
+    Tree tree;
+    Tree copy;
+    std::array<LatencyHistogram, OPERATION_COUNT> latency;
+    std::uint64_t operations = 0;
+
+    Record record;
+    Clock::time_point start = Clock::now();
+    double nanosecondsPerTick = 1.0 / reader.TicksPerNanosecond();
+
+    while ( reader.Next(record) )
+    {
+        if (record.operation >= OPERATION_COUNT) continue;
+
+        if (paced)
+        {
+            std::chrono::nanoseconds due( static_cast<std::int64_t>(record.ticks * nanosecondsPerTick) );
+            std::this_thread::sleep_until(start + due);
+        }
+
+        LatencyTimer timer(&latency[record.operation]);
+
+        switch ( static_cast<Tree::Operation>(record.operation) )
+        {
+        case Tree::Operation::Insert: tree.Insert( Tree::Pair(record.key, record.valueSize) ); break;
+        case Tree::Operation::Find: g_Sink = tree.Contains(record.key); break;
+        case Tree::Operation::Erase: tree.Erase(record.key); break;
+        case Tree::Operation::Copy: copy = tree; break;
+        case Tree::Operation::Clear: tree.Clear(); break;
+        }
+
+        ++operations;
+    }
+
+    double seconds = std::chrono::duration<double>( Clock::now() - start ).count();
+    double ticksPerMicrosecond = LatencyTicksPerNanosecond() * 1000;
+
+    std::printf("operations  %llu\n", static_cast<unsigned long long>(operations));
+    std::printf("dropped     %llu\n", static_cast<unsigned long long>( reader.Dropped() ));
+    std::printf("seconds     %.3f\n", seconds);
+    std::printf("throughput  %.0f ops/s\n\n", operations / seconds);
+
+    std::printf("%-8s %12s %10s %10s %10s\n", "action", "count", "p50 us", "p99 us", "p99.9 us");
+    for (std::size_t i = 0; i < OPERATION_COUNT; ++i)
+    {
+        LatencyHistogram::CountType count = latency[i].Count();
+        if (count == 0) continue;
+
+        std::printf("%-8s %12llu %10.2f %10.2f %10.2f\n", OPERATION_NAMES[i],
+                    static_cast<unsigned long long>(count),
+                    latency[i].Quantile(0.5) / ticksPerMicrosecond,
+                    latency[i].Quantile(0.99) / ticksPerMicrosecond,
+                    latency[i].Quantile(0.999) / ticksPerMicrosecond);
+    }
+}
+
+int main(int argc, char** argv)
+{
+    bool paced = false;
+    bool text = false;
+    const char* path = nullptr;
+
+    for (int i = 1; i < argc; ++i)
+    {
+        if (std::strcmp(argv[i], "--paced") == 0) paced = true;
+        else if (std::strcmp(argv[i], "--text") == 0) text = true;
+        else path = argv[i];
+    }
+
+    if (path == nullptr)
+    {
+        std::fprintf(stderr, "usage: %s [--paced | --text] TRACE\n", argv[0]);
+        return 1;
+    }
+
+    TraceReader<std::uint64_t> reader(path);
+    if ( !reader.IsOpen() )
+    {
+        std::fprintf(stderr, "%s is not a trace of 64-bit keys\n", path);
+        return 1;
+    }
+
+    if (text) PrintText(reader);
+    else Replay(reader, paced);
+
+    return 0;
+}
@@ -0,0 +1,411 @@
+// This drives the binary search tree with a mixed workload, in the
+// style of YCSB. A run loads records, warms up, and then measures the
+// throughput and latency of reads, inserts, updates, erases and scans
+// for a fixed time, over any number of threads. Threads share one tree
+// behind a reader-writer lock. A recorded text trace can be replayed
+// instead, to reproduce a production workload offline.
+//
+// Build and run from this directory:
+//
+//     g++ -O2 -std=c++17 -pthread -I.. workload_driver.cpp -o workload_driver
+//     ./workload_driver --records=1000000 --mix=50:0:50:0:0 --distribution=zipfian
+//     ./workload_driver --threads=4 --warmup=2 --duration=10 --mix=95:5:0:0:0
+//     ./workload_driver --trace=production.trace
+//     ./workload_driver --mix=90:0:0:0:10 --hash-index=0.5
+//
+// The mix is the percentage of reads, inserts, updates, erases and
+// scans. Distributions are uniform, zipfian, latest and sequential.
+// A hash index with the given maximum load speeds up reads, updates
+// and erases, while scans still walk the tree.
+// Trace lines are an action and a key, and scans also have a length:
+//
+//     read 42
+//     insert 42
+//     update 42
+//     erase 42
+//     scan 42 100
+//
+// Blank lines and lines starting with # are skipped. A trace is
+// replayed once after the records are loaded, with its lines dealt
+// out to the threads in turn. Use --records=0 to replay on an empty
+// tree.
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <mutex>
+#include <random>
+#include <shared_mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "binary_search_tree.hpp"
+#include "key_generator.hpp"
+
+using Tree = BinarySearchTree<std::uint64_t, std::uint64_t>;
+
+enum class Action
+{
+    Read,
+    Insert,
+    Update,
+    Erase,
+    Scan
+};
+
+static constexpr std::size_t ACTION_COUNT = 5;
+static const char* const ACTION_NAMES[ACTION_COUNT] = { "read", "insert", "update", "erase", "scan" };
+
+struct TraceEntry
+{
+    Action action;
+    std::uint64_t key;
+    std::uint64_t length;
+};
+
+struct Options
+{
+    std::uint64_t records = 1000000;
+    std::size_t threads = 1;
+    double warmup = 1;
+    double duration = 5;
+    unsigned mix[ACTION_COUNT] = { 50, 0, 50, 0, 0 };
+    KeyDistribution distribution = KeyDistribution::Zipfian;
+    std::uint64_t scanLength = 100;
+    std::uint64_t seed = 42;
+    std::string trace;
+
+    // the maximum load of the hash index, or zero for none
+    double hashIndex = 0;
+};
+
+// The state shared by every thread of a run.
+struct Workload
+{
+    Tree tree;
+    std::shared_mutex mutex;
+
+    std::atomic<std::uint64_t> records{0};
+    std::atomic<bool> measuring{false};
+    std::atomic<bool> stopping{false};
+    std::atomic<std::uint64_t> operations{0};
+
+    std::array<LatencyHistogram, ACTION_COUNT> latency;
+};
+
+// keeps lookups from being optimized away
+static std::atomic<std::uint64_t> g_Sink{0};
+
+/**
+ * @brief Reads the command line.
+ * @param argc The number of arguments.
+ * @param argv The arguments.
+ * @param options Where to put the options.
+ * @return Whether every argument was understood.
+ */
+bool ParseOptions(int argc, char** argv, Options& options)
+{
+    for (int i = 1; i < argc; ++i)
+    {
+        std::string argument = argv[i];
+        std::size_t equals = argument.find('=');
+        if (argument.compare(0, 2, "--") != 0 || equals == std::string::npos) return false;
+
+        std::string name = argument.substr(2, equals - 2);
+        std::string value = argument.substr(equals + 1);
+
+        if (name == "records") options.records = std::strtoull(value.c_str(), nullptr, 10);
+        else if (name == "threads") options.threads = std::strtoull(value.c_str(), nullptr, 10);
+        else if (name == "warmup") options.warmup = std::strtod(value.c_str(), nullptr);
+        else if (name == "duration") options.duration = std::strtod(value.c_str(), nullptr);
+        else if (name == "scan") options.scanLength = std::strtoull(value.c_str(), nullptr, 10);
+        else if (name == "seed") options.seed = std::strtoull(value.c_str(), nullptr, 10);
+        else if (name == "trace") options.trace = value;
+        else if (name == "hash-index") options.hashIndex = std::strtod(value.c_str(), nullptr);
+        else if (name == "mix")
+        {
+            unsigned total = 0;
+            std::istringstream in(value);
+            for (std::size_t action = 0; action < ACTION_COUNT; ++action)
+            {
+                char colon = ':';
+                if ( (action > 0 && !(in >> colon)) || colon != ':' || !(in >> options.mix[action]) ) return false;
+                total += options.mix[action];
+            }
+            if (total != 100) return false;
+        }
+        else if (name == "distribution")
+        {
+            if (value == "uniform") options.distribution = KeyDistribution::Uniform;
+            else if (value == "zipfian") options.distribution = KeyDistribution::Zipfian;
+            else if (value == "latest") options.distribution = KeyDistribution::Latest;
+            else if (value == "sequential") options.distribution = KeyDistribution::Sequential;
+            else return false;
+        }
+        else return false;
+    }
+
+    return options.threads > 0 && (options.records > 0 || !options.trace.empty());
+}
+
+/**
+ * @brief Reads a text trace.
+ * @param path The path of the trace.
+ * @param trace Where to put the entries of the trace.
+ * @return Whether the whole trace could be read.
+ */
+bool LoadTrace(const std::string& path, std::vector<TraceEntry>& trace)
+{
+    std::ifstream file(path);
+    if (!file) return false;
+
+    std::string line;
+    while ( std::getline(file, line) )
+    {
+        std::istringstream in(line);
+        std::string name;
+        if ( !(in >> name) || name[0] == '#' ) continue;
+
+        TraceEntry entry = { Action::Read, 0, 0 };
+        std::size_t action = 0;
+        while ( action < ACTION_COUNT && name != ACTION_NAMES[action] ) ++action;
+        if (action == ACTION_COUNT || !(in >> entry.key) ) return false;
+
+        entry.action = static_cast<Action>(action);
+        if ( entry.action == Action::Scan && !(in >> entry.length) ) return false;
+
+        trace.push_back(entry);
+    }
+
+    return true;
+}
+
+/**
+ * @brief Performs one operation on the shared tree.
+ * @param workload The shared state of the run.
+ * @param action What to do.
+ * @param key The key to do it to.
+ * @param length The number of keys to scan.
+ * 
+ * Reads and scans share the lock, and everything else holds it alone.
+ * An update only changes a key that is in the tree.
+ */
+void Perform(Workload& workload, Action action, std::uint64_t key, std::uint64_t length)
+{
+    const Tree& tree = workload.tree;
+
+    switch (action)
+    {
+    case Action::Read:
+    {
+        std::shared_lock<std::shared_mutex> lock(workload.mutex);
+        g_Sink.fetch_add(tree.Contains(key), std::memory_order_relaxed);
+        break;
+    }
+
+    case Action::Insert:
+    {
+        std::unique_lock<std::shared_mutex> lock(workload.mutex);
+        workload.tree.Insert( Tree::Pair(key, key) );
+        break;
+    }
+
+    case Action::Update:
+    {
+        std::unique_lock<std::shared_mutex> lock(workload.mutex);
+        if ( workload.tree.Contains(key) ) ++workload.tree.Find(key);
+        break;
+    }
+
+    case Action::Erase:
+    {
+        std::unique_lock<std::shared_mutex> lock(workload.mutex);
+        workload.tree.Erase(key);
+        break;
+    }
+
+    // a scan descends once, and then walks in order
+    case Action::Scan:
+    {
+        std::shared_lock<std::shared_mutex> lock(workload.mutex);
+        std::uint64_t sum = 0;
+        tree.ForEachFrom(key, length, [&sum](const Tree::Pair& data) { sum += data.second; });
+
+        g_Sink.fetch_add(sum, std::memory_order_relaxed);
+        break;
+    }
+    }
+}
+
+/**
+ * @brief Runs one operation, and measures it.
+ * @param workload The shared state of the run.
+ * @param action What to do.
+ * @param key The key to do it to.
+ * @param length The number of keys to scan.
+ * @return Whether the operation was measured.
+ */
+bool Measure(Workload& workload, Action action, std::uint64_t key, std::uint64_t length)
+{
+    bool measuring = workload.measuring.load(std::memory_order_relaxed);
+    LatencyTimer timer( measuring ? &workload.latency[ static_cast<std::size_t>(action) ] : nullptr );
+
+    Perform(workload, action, key, length);
+    return measuring;
+}
+
+/**
+ * @brief Runs the generated workload on one thread.
+ * @param workload The shared state of the run.
+ * @param options The options of the run.
+ * @param zipfian The popularity of records.
+ * @param thread The index of the thread.
+ * 
+ * Runs until the run is stopped, counting the operations made while
+ * it was measured.
+ */
+void RunGenerated(Workload& workload, const Options& options, const ZipfianGenerator& zipfian, std::size_t thread)
+{
+    // sequential threads start spread out over the records
+    std::uint64_t seed = options.distribution == KeyDistribution::Sequential ?
+        thread * (options.records / options.threads) : options.seed + thread;
+
+    KeyGenerator keys(options.distribution, zipfian, workload.records, seed);
+    std::uniform_int_distribution<unsigned> percent(0, 99);
+    std::uint64_t operations = 0;
+
+    while ( !workload.stopping.load(std::memory_order_relaxed) )
+    {
+        unsigned roll = percent( keys.Random() );
+        std::size_t action = 0;
+        while (roll >= options.mix[action])
+            roll -= options.mix[action++];
+
+        std::uint64_t key = static_cast<Action>(action) == Action::Insert ?
+            RecordKey( workload.records.fetch_add(1, std::memory_order_relaxed) ) : keys.Next();
+
+        operations += Measure(workload, static_cast<Action>(action), key, options.scanLength);
+    }
+
+    workload.operations.fetch_add(operations, std::memory_order_relaxed);
+}
+
+/**
+ * @brief Replays part of a trace on one thread.
+ * @param workload The shared state of the run.
+ * @param trace The entries of the trace.
+ * @param thread The index of the thread.
+ * @param threads The number of threads.
+ */
+void RunTrace(Workload& workload, const std::vector<TraceEntry>& trace, std::size_t thread, std::size_t threads)
+{
+    std::uint64_t operations = 0;
+
+    for (std::size_t i = thread; i < trace.size(); i += threads)
+        operations += Measure(workload, trace[i].action, trace[i].key, trace[i].length);
+
+    workload.operations.fetch_add(operations, std::memory_order_relaxed);
+}
+
+/**
+ * @brief Prints the results of a run.
+ * @param workload The shared state of the run.
+ * @param seconds How long the run was measured for.
+ */
+void Report(const Workload& workload, double seconds)
+{
+    std::uint64_t operations = workload.operations.load();
+    double ticksPerMicrosecond = LatencyTicksPerNanosecond() * 1000;
+
+    std::printf("operations  %llu\n", static_cast<unsigned long long>(operations));
+    std::printf("seconds     %.3f\n", seconds);
+    std::printf("throughput  %.0f ops/s\n", operations / seconds);
+    if ( workload.tree.HashIndexBytes() > 0 )
+        std::printf("hash index  %zu bytes\n", workload.tree.HashIndexBytes());
+    std::printf("\n");
+
+    std::printf("%-8s %12s %10s %10s %10s %10s\n", "action", "count", "p50 us", "p99 us", "p99.9 us", "max us");
+    for (std::size_t action = 0; action < ACTION_COUNT; ++action)
+    {
+        const LatencyHistogram& latency = workload.latency[action];
+        LatencyHistogram::CountType count = latency.Count();
+        if (count == 0) continue;
+
+        std::printf("%-8s %12llu %10.2f %10.2f %10.2f %10.2f\n", ACTION_NAMES[action],
+                    static_cast<unsigned long long>(count),
+                    latency.Quantile(0.5) / ticksPerMicrosecond,
+                    latency.Quantile(0.99) / ticksPerMicrosecond,
+                    latency.Quantile(0.999) / ticksPerMicrosecond,
+                    latency.Quantile(1.0) / ticksPerMicrosecond);
+    }
+}
+
+int main(int argc, char** argv)
+{
+    using Clock = std::chrono::steady_clock;
+
+    Options options;
+
+    if ( !ParseOptions(argc, argv, options) )
+    {
+        std::fprintf(stderr, "usage: %s [--records=N] [--threads=N] [--warmup=S] [--duration=S]\n"
+                             "       [--mix=READ:INSERT:UPDATE:ERASE:SCAN] [--scan=N] [--seed=N]\n"
+                             "       [--distribution=uniform|zipfian|latest|sequential] [--trace=PATH]\n"
+                             "       [--hash-index=LOAD]\n", argv[0]);
+        return 1;
+    }
+
+    std::vector<TraceEntry> trace;
+    if ( !options.trace.empty() && !LoadTrace(options.trace, trace) )
+    {
+        std::fprintf(stderr, "could not read the trace %s\n", options.trace.c_str());
+        return 1;
+    }
+
+    // records are loaded in order, since their keys are scrambled
+    Workload workload;
+    if (options.hashIndex > 0) workload.tree.EnableHashIndex(options.hashIndex);
+    for (std::uint64_t record = 0; record < options.records; ++record)
+        workload.tree.Insert( Tree::Pair( RecordKey(record), record ) );
+    workload.records.store(options.records);
+
+    std::vector<std::thread> threads;
+    Clock::time_point start;
+
+    if ( !trace.empty() )
+    {
+        workload.measuring.store(true);
+        start = Clock::now();
+
+        for (std::size_t thread = 0; thread < options.threads; ++thread)
+            threads.emplace_back(RunTrace, std::ref(workload), std::cref(trace), thread, options.threads);
+        for (std::thread& thread : threads)
+            thread.join();
+    }
+    else
+    {
+        ZipfianGenerator zipfian(options.records);
+
+        for (std::size_t thread = 0; thread < options.threads; ++thread)
+            threads.emplace_back(RunGenerated, std::ref(workload), std::cref(options), std::cref(zipfian), thread);
+
+        std::this_thread::sleep_for( std::chrono::duration<double>(options.warmup) );
+        workload.measuring.store(true);
+        start = Clock::now();
+
+        std::this_thread::sleep_for( std::chrono::duration<double>(options.duration) );
+        workload.stopping.store(true);
+        for (std::thread& thread : threads)
+            thread.join();
+    }
+
+    Report( workload, std::chrono::duration<double>( Clock::now() - start ).count() );
+    return 0;
+}
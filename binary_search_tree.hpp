@@ -8,22 +8,146 @@
 #pragma once
 
 #include <utility>
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <new>
 #include <queue>
+#include <type_traits>
+#include <vector>
 #include <iostream>
 
+#include "bst_probes.hpp"
+#include "latency_histogram.hpp"
+#include "sample_ring.hpp"
+#include "trace_recorder.hpp"
+
+// This gets the key and the value from the data of a node. When a
+// key extractor is given, nodes store only the value, and its key is
+// taken from it by calling a default constructed extractor.
+template<typename KeyType, typename ValueType, typename KeyOfValue>
+struct BinarySearchTreeData
+{
+    using Type = ValueType;
+
+    static auto Key(const Type& data) -> decltype( KeyOfValue()(data) ) { return KeyOfValue()(data); }
+    static ValueType& Value(Type& data) { return data; }
+    static const ValueType& Value(const Type& data) { return data; }
+};
+
+// Without an extractor, nodes store the key and the value in a pair.
 template<typename KeyType, typename ValueType>
+struct BinarySearchTreeData<KeyType, ValueType, void>
+{
+    using Type = std::pair<KeyType, ValueType>;
+
+    static const KeyType& Key(const Type& data) { return data.first; }
+    static ValueType& Value(Type& data) { return data.second; }
+    static const ValueType& Value(const Type& data) { return data.second; }
+};
+
+// These are the features a tree can give its nodes, as the bits of
+// its last template parameter. Without them, a node holds only its
+// data and children, and the tree pays nothing for them.
+//
+// BST_SHARED_NODES counts the references to each node, so copies of
+// the tree share its nodes until one of them changes them. Without it,
+// a copy copies every node up front.
+//
+// BST_LAZY_ERASE marks each node as erased or not, so SetLazyErase can
+// defer unlinking erased nodes and purge them in bulk.
+//
+// BST_ACCESS_COUNTS gives each node a hit counter, which finds bump
+// while access counting is enabled, for Accesses and Relayout.
+static constexpr unsigned BST_SHARED_NODES = 1;
+static constexpr unsigned BST_LAZY_ERASE = 2;
+static constexpr unsigned BST_ACCESS_COUNTS = 4;
+
+// These are the fields of the node features, which are empty when a
+// tree does not use them.
+template<bool Shared>
+struct BinaryNodeRefs
+{
+    // the number of trees and parent nodes sharing the node
+    std::atomic<std::size_t> refs{1};
+};
+
+template<>
+struct BinaryNodeRefs<false> { };
+
+template<bool Lazy>
+struct BinaryNodeTombstone
+{
+    // whether the node was lazily erased, and is waiting to be purged
+    bool erased = false;
+};
+
+template<>
+struct BinaryNodeTombstone<false> { };
+
+template<bool Counted>
+struct BinaryNodeHits
+{
+    // the number of times the node was found while accesses were being
+    // counted
+    mutable std::atomic<std::uint32_t> hits{0};
+};
+
+template<>
+struct BinaryNodeHits<false> { };
+
+template<typename KeyType, typename ValueType, typename KeyOfValue = void, unsigned Features = 0>
 class BinarySearchTree
 {
+    using Data = BinarySearchTreeData<KeyType, ValueType, KeyOfValue>;
+
+    // the node features the tree was given
+    static constexpr bool SHARED_NODES = (Features & BST_SHARED_NODES) != 0;
+    static constexpr bool LAZY_ERASE = (Features & BST_LAZY_ERASE) != 0;
+    static constexpr bool ACCESS_COUNTS = (Features & BST_ACCESS_COUNTS) != 0;
+
 public:
     using SizeType       = std::size_t;
-    using Pair           = std::pair<KeyType, ValueType>;
+
+    // the data of a node, which is a key and value pair, or only the
+    // value when its key is extracted from it
+    using Pair           = typename Data::Type;
     using Pointer        = Pair*;
     using ConstPointer   = const Pair*;
     using Reference      = Pair&;
     using ConstReference = const Pair&;
 
+    // the number of times each key was accessed
+    using AccessProfile = std::vector< std::pair<KeyType, std::uint64_t> >;
+
+    // operations whose latency can be recorded or traced
+    enum class Operation { Insert, Find, Erase, Copy, Clear };
+    static constexpr SizeType OPERATION_COUNT = 5;
+
+    struct OperationStats
+    {
+        LatencyHistogram latency[OPERATION_COUNT];
+    };
+
+    // an operation that was slower or deeper than the sampling thresholds
+    struct SlowSample
+    {
+        KeyType key;
+        Operation operation;
+        SizeType depth;
+
+        // the first 64 turns, as bits that are set for right turns
+        std::uint64_t turns;
+        std::uint64_t ticks;
+    };
+
 private:
-    struct BinaryNode
+    struct BinaryNode : BinaryNodeRefs<SHARED_NODES>,
+                        BinaryNodeTombstone<LAZY_ERASE>,
+                        BinaryNodeHits<ACCESS_COUNTS>
     {
         Pair data;
         BinaryNode* left;
@@ -65,278 +189,2719 @@ private:
     using NodePointer      = BinaryNode*;
     using ConstNodePointer = const BinaryNode*;
 
+    // the path taken by a descent from the root
+    struct Descent
+    {
+        // the number of turns taken, where the first 64 turns are kept
+        // as bits that are set for right turns
+        SizeType depth = 0;
+        std::uint64_t turns = 0;
+
+        // the node the descent ended at, if there is one, and whether
+        // the tree was changed there
+        ConstNodePointer node = nullptr;
+        bool changed = false;
+
+        void Turn(bool right)
+        {
+            if (right && depth < 64) turns |= std::uint64_t(1) << depth;
+            ++depth;
+        }
+    };
+
+    // This hands out node slots from slabs, through a free list. Copies
+    // of a tree share its pool, and lock it only while they do, so a
+    // tree that was never copied takes no lock. Freed slots are kept
+    // for new nodes, and slabs are only returned when the pool is
+    // destroyed, which is how Shrink and Relayout release them.
+    class NodePool
+    {
+        // a node slot, which holds the next free slot while unused
+        union Slot
+        {
+            Slot* next;
+            alignas(BinaryNode) unsigned char node[ sizeof(BinaryNode) ];
+        };
+
+        struct Slab
+        {
+            Slot* slots;
+            SizeType capacity;
+        };
+
+        // slabs grow geometrically up to this many slots
+        static constexpr SizeType MAX_SLAB_CAPACITY = 4096;
+
+        std::mutex m_Mutex;
+        std::vector<Slab> m_Slabs;
+        Slot* m_Free;
+        SizeType m_Live;
+        SizeType m_Reserved;
+
+    public:
+        /**
+         * @brief Default constructor.
+         * @param capacity The number of slots in the first slab.
+         * 
+         * Creates a pool with one slab of free slots.
+         */
+        NodePool(SizeType capacity = 32)
+            : m_Free(nullptr),
+              m_Live(0),
+              m_Reserved(0)
+        {
+            Grow(capacity);
+        }
+
+        NodePool(const NodePool&) = delete;
+        NodePool& operator=(const NodePool&) = delete;
+
+        ~NodePool()
+        {
+            for (const Slab& slab : m_Slabs)
+                ::operator delete(slab.slots);
+        }
+
+        // get the memory used by live nodes, and held by the pool
+        SizeType LiveBytes() { std::lock_guard<std::mutex> lock(m_Mutex); return m_Live * sizeof(Slot); }
+        SizeType ReservedBytes() { std::lock_guard<std::mutex> lock(m_Mutex); return m_Reserved * sizeof(Slot); }
+
+        /**
+         * @brief Allocates memory for a node.
+         * @param shared Whether other trees use the pool, and it must
+         *               be locked.
+         * @return An uninitialized slot.
+         * 
+         * Takes the first free slot, adding a slab if there is none.
+         */
+        void* Allocate(bool shared)
+        {
+            std::unique_lock<std::mutex> lock(m_Mutex, std::defer_lock);
+            if (shared) lock.lock();
+
+            if (m_Free == nullptr)
+                Grow( m_Reserved < MAX_SLAB_CAPACITY ? m_Reserved : MAX_SLAB_CAPACITY );
+
+            Slot* slot = m_Free;
+            m_Free = slot->next;
+            ++m_Live;
+
+            return slot;
+        }
+
+        /**
+         * @brief Frees the memory of a node.
+         * @param memory A slot whose node was already destructed.
+         * @param shared Whether other trees use the pool, and it must
+         *               be locked.
+         * 
+         * Puts the slot at the front of the free list.
+         */
+        void Deallocate(void* memory, bool shared)
+        {
+            std::unique_lock<std::mutex> lock(m_Mutex, std::defer_lock);
+            if (shared) lock.lock();
+
+            Slot* slot = static_cast<Slot*>(memory);
+            slot->next = m_Free;
+            m_Free = slot;
+            --m_Live;
+        }
+
+    private:
+        /**
+         * @brief Adds a slab to the pool.
+         * @param capacity The number of slots in the slab.
+         * 
+         * Links the new slots into the free list in address order.
+         */
+        void Grow(SizeType capacity)
+        {
+            if (capacity == 0) capacity = 1;
+
+            Slot* slots = static_cast<Slot*>( ::operator new( capacity * sizeof(Slot) ) );
+            m_Slabs.push_back( Slab{slots, capacity} );
+            m_Reserved += capacity;
+
+            for (SizeType i = capacity; i > 0; --i)
+            {
+                slots[i - 1].next = m_Free;
+                m_Free = &slots[i - 1];
+            }
+        }
+    };
+
+    // whether keys have a std::hash, which the hash index needs
+    static constexpr bool HASHABLE = std::is_default_constructible< std::hash<KeyType> >::value;
+
+    // This maps keys to their nodes with open addressing. Slots are
+    // probed linearly, and keep the high half of their key's hash, so
+    // most probes never visit a node. Erased slots are filled by
+    // shifting the rest of their run back, so no tombstones are left
+    // behind.
+    //
+    // Copies of a tree share its index until one of them changes it.
+    // Each slot is stamped with the epoch it was written in, and a copy
+    // starts a new epoch, so a node is only known to be owned by one
+    // tree when its slot was written since the last copy.
+    class HashIndex
+    {
+        struct Slot
+        {
+            std::uint32_t hash;
+            std::uint32_t epoch;
+            NodePointer node;
+        };
+
+        // the index starts with 2^MIN_CAPACITY_BITS slots
+        static constexpr SizeType MIN_CAPACITY_BITS = 4;
+
+        // the epoch of slots whose nodes may be shared
+        static constexpr std::uint32_t SHARED = 0;
+
+        std::vector<Slot> m_Slots;
+        SizeType m_Count;
+        SizeType m_Shift;
+        double m_MaxLoad;
+
+        // copies of the tree start a new epoch even when it is const
+        std::atomic<std::uint32_t> m_Epoch;
+
+    public:
+        /**
+         * @brief Default constructor.
+         * @param maxLoad The most slots that can be full, between 0 and 1.
+         * 
+         * Creates an empty index.
+         */
+        explicit HashIndex(double maxLoad)
+            : m_Count(0),
+              m_Shift(0),
+              m_MaxLoad(maxLoad),
+              m_Epoch(SHARED + 1)
+        {
+            Reset(0);
+        }
+
+        // copies of the index are made for the tree that writes first
+        HashIndex(const HashIndex& other)
+            : m_Slots(other.m_Slots),
+              m_Count(other.m_Count),
+              m_Shift(other.m_Shift),
+              m_MaxLoad(other.m_MaxLoad),
+              m_Epoch( other.m_Epoch.load(std::memory_order_relaxed) )
+        { }
+
+        HashIndex& operator=(const HashIndex&) = delete;
+
+        // get the memory used by the slots, and the maximum load
+        SizeType Bytes() const { return m_Slots.size() * sizeof(Slot); }
+        double MaxLoad() const { return m_MaxLoad; }
+
+        /**
+         * @brief Empties the index.
+         * @param nodes The number of nodes to make room for.
+         * 
+         * Sizes the slots to the smallest power of two that holds the
+         * nodes without passing the maximum load.
+         */
+        void Reset(SizeType nodes)
+        {
+            SizeType bits = MIN_CAPACITY_BITS;
+            while ( nodes > m_MaxLoad * (SizeType(1) << bits) ) ++bits;
+
+            m_Slots.assign( SizeType(1) << bits, Slot{0, SHARED, nullptr} );
+            m_Count = 0;
+            m_Shift = 32 - bits;
+        }
+
+        /**
+         * @brief Starts a new epoch.
+         * 
+         * Called when the tree is copied, since every node it had is
+         * now shared. When the epochs wrap around, every slot is marked
+         * as shared instead.
+         */
+        void Disown()
+        {
+            std::uint32_t epoch = m_Epoch.load(std::memory_order_relaxed) + 1;
+
+            if (epoch == SHARED)
+            {
+                for (Slot& slot : m_Slots)
+                    slot.epoch = SHARED;
+                ++epoch;
+            }
+
+            m_Epoch.store(epoch, std::memory_order_relaxed);
+        }
+
+        // find the node of a key, which may be lazily erased
+        NodePointer Find(const KeyType& key) const
+        {
+            const Slot* slot = Lookup(key);
+            return slot ? slot->node : nullptr;
+        }
+
+        // find the node of a key, if it is owned by this tree alone
+        NodePointer FindOwned(const KeyType& key) const
+        {
+            const Slot* slot = Lookup(key);
+            return slot && slot->epoch == m_Epoch.load(std::memory_order_relaxed) ? slot->node : nullptr;
+        }
+
+        /**
+         * @brief Adds a node.
+         * @param node The node to add.
+         * @param owned Whether the node is owned by this tree alone.
+         * 
+         * A key that is already indexed is pointed at the new node, which
+         * is how copies of shared nodes take over from the originals.
+         */
+        void Insert(NodePointer node, bool owned)
+        {
+            if (m_Count + 1 > m_MaxLoad * m_Slots.size()) Grow();
+
+            std::uint32_t hash = Hash( KeyOf(node->data) );
+            std::uint32_t epoch = owned ? m_Epoch.load(std::memory_order_relaxed) : SHARED;
+            SizeType i = Home(hash);
+
+            for ( ; m_Slots[i].node != nullptr; i = Next(i) )
+            {
+                if ( m_Slots[i].hash == hash && Equal(KeyOf(m_Slots[i].node->data), KeyOf(node->data)) )
+                {
+                    m_Slots[i].node = node;
+                    m_Slots[i].epoch = epoch;
+                    return;
+                }
+            }
+
+            m_Slots[i] = Slot{hash, epoch, node};
+            ++m_Count;
+        }
+
+        /**
+         * @brief Removes a node.
+         * @param node The node to remove, which must still hold its key.
+         * 
+         * Nothing is removed when the key points at another node. Later
+         * slots of the run are shifted back into the hole, unless that
+         * would move them before their home slot.
+         */
+        void Remove(ConstNodePointer node)
+        {
+            SizeType i = Home( Hash( KeyOf(node->data) ) );
+            for ( ; m_Slots[i].node != node; i = Next(i) )
+            {
+                if (m_Slots[i].node == nullptr) return;
+            }
+
+            for (SizeType j = Next(i); m_Slots[j].node != nullptr; j = Next(j))
+            {
+                // a slot whose home is cyclically in (i, j] has to stay
+                SizeType home = Home(m_Slots[j].hash);
+                bool stays = i < j ? ( home > i && !(home > j) ) : ( home > i || !(home > j) );
+
+                if (!stays)
+                {
+                    m_Slots[i] = m_Slots[j];
+                    i = j;
+                }
+            }
+
+            m_Slots[i] = Slot{0, SHARED, nullptr};
+            --m_Count;
+        }
+
+    private:
+        // find the slot of a key, or nullptr if it is not indexed
+        const Slot* Lookup(const KeyType& key) const
+        {
+            std::uint32_t hash = Hash(key);
+
+            for (SizeType i = Home(hash); m_Slots[i].node != nullptr; i = Next(i))
+            {
+                if ( m_Slots[i].hash == hash && Equal(KeyOf(m_Slots[i].node->data), key) )
+                    return &m_Slots[i];
+            }
+
+            return nullptr;
+        }
+
+        // double the slots, and put every node back
+        void Grow()
+        {
+            std::vector<Slot> slots;
+            slots.swap(m_Slots);
+            m_Slots.assign( slots.size() * 2, Slot{0, SHARED, nullptr} );
+            --m_Shift;
+
+            for (const Slot& slot : slots)
+            {
+                if (slot.node == nullptr) continue;
+
+                SizeType i = Home(slot.hash);
+                while (m_Slots[i].node != nullptr) i = Next(i);
+                m_Slots[i] = slot;
+            }
+        }
+
+        // spread the hash over its high half, whose top bits pick the
+        // home slot, where keys without a std::hash are never indexed
+        static std::uint32_t Hash(const KeyType& key) { return Hash( key, std::integral_constant<bool, HASHABLE>() ); }
+        static std::uint32_t Hash(const KeyType&, std::false_type) { return 0; }
+        static std::uint32_t Hash(const KeyType& key, std::true_type)
+        {
+            return static_cast<std::uint32_t>( (KeyHash(key) * 0x9e3779b97f4a7c15ULL) >> 32 );
+        }
+
+        SizeType Home(std::uint32_t hash) const { return static_cast<SizeType>(hash >> m_Shift); }
+        SizeType Next(SizeType i) const { return (i + 1) & (m_Slots.size() - 1); }
+
+        template<typename Key>
+        static bool Equal(const Key& a, const KeyType& b) { return !(a < b) && !(b < a); }
+    };
+
+    // the pool is shared by every tree that may share nodes
+    std::shared_ptr<NodePool> m_Pool;
+
+    // the recorded latencies, shared with copies of the tree,
+    // or nullptr when they are not being recorded
+    std::shared_ptr<OperationStats> m_Stats;
+
+    struct SlowSampler
+    {
+        std::uint64_t latencyThreshold;
+        SizeType depthThreshold;
+        SampleRing<SlowSample> samples;
+
+        SlowSampler(std::uint64_t latency, SizeType depth, SizeType capacity)
+            : latencyThreshold(latency),
+              depthThreshold(depth),
+              samples(capacity)
+        { }
+    };
+
+    // the slow operation samples, shared with copies of the tree,
+    // or nullptr when operations are not being sampled
+    std::shared_ptr<SlowSampler> m_Sampler;
+
+    // the recorder of every operation, shared with copies of the tree,
+    // or nullptr when operations are not being traced
+    std::shared_ptr< TraceRecorder<KeyType> > m_Recorder;
+
     NodePointer m_Root;
     SizeType m_Size;
 
+    // cached paths from the root to the minimum and maximum nodes,
+    // left empty when they need to be rebuilt
+    std::vector<NodePointer> m_LeftSpine;
+    std::vector<NodePointer> m_RightSpine;
+
+    // whether every node on a cached spine is owned by this tree alone,
+    // which copies of the tree clear even when it is const
+    mutable std::atomic<bool> m_LeftSpineOwned{false};
+    mutable std::atomic<bool> m_RightSpineOwned{false};
+
+    // the number of times the tree was copied, which tells cursors that
+    // the nodes they own may be shared again
+    mutable std::atomic<std::uint64_t> m_Copies{0};
+
+    // the number of lazily erased nodes, and how many are allowed
+    // before they are purged (zero when erasing is not lazy)
+    SizeType m_Tombstones = 0;
+    SizeType m_PurgeThreshold = 0;
+
+    // whether finds count the hits of the nodes they find
+    bool m_CountAccesses = false;
+
+    // the index of every node by key, including lazily erased ones,
+    // shared with copies of the tree until one of them changes it, or
+    // nullptr when finds descend the tree
+    std::shared_ptr<HashIndex> m_Index;
+
 public:
-    /**
-     * @brief Default constructor.
-     * 
-     * Creates a tree with nullptr as the root.
-     */
-    BinarySearchTree()
-        : m_Root(nullptr),
-          m_Size(0)
-    { }
+    // This walks the tree in order, and can erase and insert nodes as
+    // it goes. It keeps the links from the root to its node, so a step
+    // never descends from the root again, and a whole pass takes O(n)
+    // steps. Every node it steps onto is copied first if it is
+    // shared, and the whole path is copied again before a change if
+    // the tree was copied in the meantime, so changes never reach
+    // copies of the tree. Lazily erased nodes are stepped over, and
+    // left for the purge threshold. Changing the tree any other way
+    // invalidates the cursor.
+    class Cursor
+    {
+        friend class BinarySearchTree;
+
+        BinarySearchTree* m_Tree;
+
+        // the links from the root to the node at the cursor, which is
+        // past either end when there are none
+        std::vector<NodePointer*> m_Path;
+
+        // the copies of the tree made before the path was last owned
+        std::uint64_t m_Copies;
+
+        // the spines are kept up to date as the cursor changes the tree
+        explicit Cursor(BinarySearchTree& tree)
+            : m_Tree(&tree),
+              m_Copies( tree.m_Copies.load(std::memory_order_relaxed) )
+        {
+            m_Tree->UpdateSpines();
+        }
+
+    public:
+        // whether the cursor is at a node
+        bool Valid() const { return !m_Path.empty(); }
+
+        // get the data at the cursor, which must be valid
+        ConstReference Data() const { return (*m_Path.back())->data; }
+        ValueType& Value()
+        {
+            Own();
+            return ValueOf( (*m_Path.back())->data );
+        }
+
+        /**
+         * @brief Moves to the next node.
+         * @return Whether the cursor is still at a node.
+         * 
+         * The next node is the minimum of the right subtree, or else the
+         * nearest ancestor whose left subtree the cursor is in. Lazily
+         * erased nodes are stepped over.
+         */
+        bool Next()
+        {
+            if ( m_Path.empty() ) return false;
+
+            StepNext();
+            SkipErased();
+            return Valid();
+        }
+
+        /**
+         * @brief Moves to the previous node.
+         * @return Whether the cursor is still at a node.
+         * 
+         * The previous node is the maximum of the left subtree, or else
+         * the nearest ancestor whose right subtree the cursor is in.
+         * Lazily erased nodes are stepped over.
+         */
+        bool Prev()
+        {
+            if ( m_Path.empty() ) return false;
+
+            StepPrev();
+            SkipErasedBack();
+            return Valid();
+        }
+
+        /**
+         * @brief Erases the node at the cursor.
+         * @return Whether there is a next node, which the cursor is at.
+         * 
+         * A node with two children is replaced by its successor, which
+         * is unlinked from the bottom of the right subtree, so the tree
+         * takes the same shape as it would after Erase. Erasing the
+         * minimum or maximum also removes the lazily erased nodes that
+         * it leaves at the end, so Min and Max stay live.
+         */
+        bool EraseHere()
+        {
+            LatencyTimer timer( m_Tree->Latency(Operation::Erase) );
+
+            Own();
+            NodePointer node = *m_Path.back();
+            m_Tree->Trace(Operation::Erase, KeyOf(node->data));
+
+            // a copied root can have cleared a spine
+            m_Tree->UpdateSpines();
+            bool minimum = m_Tree->m_LeftSpine.back() == node;
+            bool maximum = m_Tree->m_RightSpine.back() == node;
+
+            Unlink();
+            --m_Tree->m_Size;
+
+            // the node after the minimum is the new minimum
+            while ( minimum && Valid() && IsErased(*m_Path.back()) )
+            {
+                Unlink();
+                --m_Tree->m_Tombstones;
+            }
+
+            // the cursor is past the end after erasing the maximum
+            if (maximum) m_Tree->PurgeErasedMax();
+
+            SkipErased();
+            return Valid();
+        }
+
+        /**
+         * @brief Inserts a node right after the cursor.
+         * @param data The data of the new node, whose key must be between
+         *             the key at the cursor and the next key.
+         * 
+         * The new node becomes the right child of the node at the cursor,
+         * or else the left child of its successor. The cursor moves to
+         * the new node, so Next goes on to the node that was next.
+         */
+        void InsertAfter(ConstReference data) { Link(data); }
+        void InsertAfter(Pair&& data) { Link( std::move(data) ); }
+
+    private:
+        // link a new node in right after the cursor, and move to it
+        template<typename NewPair>
+        void Link(NewPair&& data)
+        {
+            LatencyTimer timer( m_Tree->Latency(Operation::Insert) );
+            m_Tree->Trace( Operation::Insert, KeyOf(data), TraceValueSize(ValueOf(data)) );
+
+            Own();
+            if ( m_Tree->m_Tombstones > 0 && Revive(data) ) return;
+
+            NodePointer node = m_Tree->NewNode( std::forward<NewPair>(data) );
+            NodePointer current = *m_Path.back();
+
+            if (current->right)
+            {
+                Enter(&current->right);
+                DescendLeft();
+                current = *m_Path.back();
+                current->left = node;
+                m_Path.push_back(&current->left);
+            }
+            else
+            {
+                current->right = node;
+                m_Path.push_back(&current->right);
+            }
+
+            m_Tree->Index(node);
+            ++m_Tree->m_Size;
+            m_Tree->UpdateSpines();
+        }
+
+        /**
+         * @brief Steps over the lazily erased nodes before a new key.
+         * @param data The data of the new node.
+         * @return Whether a lazily erased node had the key, and was
+         *         brought back instead.
+         * 
+         * The cursor is left at the last node before the key, erased
+         * or not, so the new node can be linked in right after it.
+         */
+        template<typename NewPair>
+        bool Revive(NewPair&& data)
+        {
+            while (1)
+            {
+                std::vector<NodePointer*> path(m_Path);
+                StepNext();
+
+                NodePointer node = Valid() ? *m_Path.back() : nullptr;
+                if ( node && IsErased(node) && KeyOf(node->data) < KeyOf(data) ) continue;
+
+                if ( node && IsErased(node) && !(KeyOf(data) < KeyOf(node->data)) )
+                {
+                    node->data = std::forward<NewPair>(data);
+                    SetErased(node, false);
+                    ++m_Tree->m_Size;
+                    --m_Tree->m_Tombstones;
+                    return true;
+                }
+
+                m_Path.swap(path);
+                return false;
+            }
+        }
+
+        /**
+         * @brief Unlinks the node at the cursor.
+         * 
+         * Deletes the node, and moves to the next one, erased or not.
+         * The spines the node was on are spliced as it is unlinked.
+         */
+        void Unlink()
+        {
+            NodePointer* link = m_Path.back();
+            NodePointer node = *link;
+            SizeType depth = m_Path.size() - 1;
+            m_Tree->Unindex(node);
+
+            if (node->left && node->right)
+            {
+                Enter(&node->right);
+                DescendLeft();
+
+                // the successor has no left child, so its right subtree
+                // takes its place
+                NodePointer* successorLink = m_Path.back();
+                NodePointer successor = *successorLink;
+                *successorLink = successor->right;
+                m_Tree->SpliceSpines(successor, *successorLink, m_Path.size() - 1);
+
+                successor->left = node->left;
+                successor->right = node->right;
+                *link = successor;
+                m_Tree->ReplaceOnSpines(node, successor, depth);
+                m_Path.resize(depth + 1);
+            }
+            else if (node->right)
+            {
+                *link = node->right;
+                m_Tree->SpliceSpines(node, *link, depth);
+                m_Path.pop_back();
+                Enter(link);
+                DescendLeft();
+            }
+            else
+            {
+                *link = node->left;
+                m_Tree->SpliceSpines(node, *link, depth);
+                AscendFromLeft();
+            }
+
+            m_Tree->DeleteNode(node);
+        }
+
+        /**
+         * @brief Owns the nodes on the path again.
+         * 
+         * A copy of the tree shares the nodes the cursor already stepped
+         * onto, so they are copied again from the root down, and the
+         * path is moved onto the copies.
+         */
+        void Own()
+        {
+            std::uint64_t copies = m_Tree->m_Copies.load(std::memory_order_relaxed);
+            if (copies == m_Copies) return;
+            m_Copies = copies;
+
+            NodePointer previous = nullptr;
+            for (SizeType i = 0; i < m_Path.size(); ++i)
+            {
+                // the link is in the node before it, which may be a copy now
+                NodePointer* link = m_Path[i];
+                if (i > 0) link = link == &previous->left ? &(*m_Path[i - 1])->left : &(*m_Path[i - 1])->right;
+
+                previous = *link;
+                if ( m_Tree->Unshare(*link) ) m_Tree->ReplaceOnSpines(previous, *link, i);
+                m_Path[i] = link;
+            }
+        }
+
+        // step onto the node of a link, copying it if it is shared
+        void Enter(NodePointer* link)
+        {
+            NodePointer node = *link;
+            if ( m_Tree->Unshare(*link) ) m_Tree->ReplaceOnSpines(node, *link, m_Path.size());
+            m_Path.push_back(link);
+        }
+
+        // step to the next or previous node, erased or not
+        void StepNext()
+        {
+            NodePointer node = *m_Path.back();
+            if (node->right)
+            {
+                Enter(&node->right);
+                DescendLeft();
+            }
+            else AscendFromLeft();
+        }
+
+        void StepPrev()
+        {
+            NodePointer node = *m_Path.back();
+            if (node->left)
+            {
+                Enter(&node->left);
+                DescendRight();
+            }
+            else AscendFromRight();
+        }
+
+        // step forwards or backwards over lazily erased nodes
+        void SkipErased()
+        {
+            while ( Valid() && IsErased(*m_Path.back()) )
+                StepNext();
+        }
+
+        void SkipErasedBack()
+        {
+            while ( Valid() && IsErased(*m_Path.back()) )
+                StepPrev();
+        }
+
+        // step down to the minimum or maximum of the node at the cursor
+        void DescendLeft()
+        {
+            while ( (*m_Path.back())->left )
+                Enter(&(*m_Path.back())->left);
+        }
+
+        void DescendRight()
+        {
+            while ( (*m_Path.back())->right )
+                Enter(&(*m_Path.back())->right);
+        }
+
+        // climb until the cursor leaves a left subtree, whose parent is
+        // next, or a right subtree, whose parent is previous
+        void AscendFromLeft()
+        {
+            while ( !m_Path.empty() )
+            {
+                NodePointer* link = m_Path.back();
+                m_Path.pop_back();
+
+                if ( !m_Path.empty() && link == &(*m_Path.back())->left ) return;
+            }
+        }
+
+        void AscendFromRight()
+        {
+            while ( !m_Path.empty() )
+            {
+                NodePointer* link = m_Path.back();
+                m_Path.pop_back();
+
+                if ( !m_Path.empty() && link == &(*m_Path.back())->right ) return;
+            }
+        }
+    };
+
+    /**
+     * @brief Default constructor.
+     * 
+     * Creates a tree with nullptr as the root.
+     */
+    BinarySearchTree()
+        : m_Root(nullptr),
+          m_Size(0)
+    { }
+
+    /**
+     * @brief Initialize constructor.
+     * @param data The data of the root.
+     * 
+     * Creates a tree with data in the root.
+     */
+    BinarySearchTree(ConstReference data)
+        : m_Root( NewNode(data) ),
+          m_Size(1)
+    { }
+
+    /**
+     * @brief Copy constructor.
+     * @param other The tree to copy.
+     * 
+     * Creates a new tree sharing the nodes of the other. Nodes are
+     * only copied once either tree changes them. Without the
+     * BST_SHARED_NODES feature, every node is copied into a pool of
+     * the new tree's own.
+     */
+    BinarySearchTree(const BinarySearchTree& other)
+        : m_Pool( SHARED_NODES ? other.m_Pool : nullptr ),
+          m_Stats(other.m_Stats),
+          m_Sampler(other.m_Sampler),
+          m_Recorder(other.m_Recorder),
+          m_Root(nullptr),
+          m_Size(other.m_Size),
+          m_Tombstones(other.m_Tombstones),
+          m_PurgeThreshold(other.m_PurgeThreshold),
+          m_CountAccesses(other.m_CountAccesses),
+          m_Index(other.m_Index)
+    {
+        LatencyTimer timer( Latency(Operation::Copy) );
+
+        CopyNodes(other);
+        Trace(Operation::Copy);
+    }
+
+    /**
+     * @brief Move constructor.
+     * @param other The tree to move.
+     * 
+     * Creates a new tree by moving the contents of the other.
+     */
+    BinarySearchTree(BinarySearchTree&& other)
+        : m_Pool( std::move(other.m_Pool) ),
+          m_Stats( std::move(other.m_Stats) ),
+          m_Sampler( std::move(other.m_Sampler) ),
+          m_Recorder( std::move(other.m_Recorder) ),
+          m_Root(other.m_Root),
+          m_Size(other.m_Size),
+          m_Tombstones(other.m_Tombstones),
+          m_PurgeThreshold(other.m_PurgeThreshold),
+          m_CountAccesses(other.m_CountAccesses),
+          m_Index( std::move(other.m_Index) )
+    {
+        other.m_Root = nullptr;
+        other.m_Size = 0;
+        other.m_Tombstones = 0;
+        other.ResetSpines();
+    }
+
+    ~BinarySearchTree() { Clear(m_Root); }
+
+    /**
+     * @brief Copy assignment operator.
+     * @param other The tree to copy.
+     * 
+     * Recreates the tree by sharing the nodes of the other.
+     */
+    BinarySearchTree& operator=(const BinarySearchTree& other)
+    {
+        if (this == &other) return *this;
+
+        LatencyTimer timer( other.Latency(Operation::Copy) );
+
+        Clear();
+        if (SHARED_NODES) m_Pool = other.m_Pool;
+        m_Stats = other.m_Stats;
+        m_Sampler = other.m_Sampler;
+        m_Recorder = other.m_Recorder;
+        m_Size = other.m_Size;
+        m_Tombstones = other.m_Tombstones;
+        m_PurgeThreshold = other.m_PurgeThreshold;
+        m_CountAccesses = other.m_CountAccesses;
+        m_Index = other.m_Index;
+        CopyNodes(other);
+        Trace(Operation::Copy);
+
+        return *this;
+    }
+
+    /**
+     * @brief Move assignment operator.
+     * @param other The tree to move.
+     * 
+     * Recreates the tree by moving the contents of the other.
+     */
+    BinarySearchTree& operator=(BinarySearchTree&& other)
+    {
+        if (this == &other) return *this;
+
+        Clear();
+        m_Pool = std::move(other.m_Pool);
+        m_Stats = std::move(other.m_Stats);
+        m_Sampler = std::move(other.m_Sampler);
+        m_Recorder = std::move(other.m_Recorder);
+        m_Root = other.m_Root;
+        m_Size = other.m_Size;
+        m_Tombstones = other.m_Tombstones;
+        m_PurgeThreshold = other.m_PurgeThreshold;
+        m_CountAccesses = other.m_CountAccesses;
+        m_Index = std::move(other.m_Index);
+        other.m_Root = nullptr;
+        other.m_Size = 0;
+        other.m_Tombstones = 0;
+        other.ResetSpines();
+
+        return *this;
+    }
+
+    // private member data getters
+    ConstReference Root() const { return ConstReference(m_Root->data); }
+    SizeType Size() const { return m_Size; }
+    bool Empty() const { return m_Size == 0; }
+    SizeType Tombstones() const { return m_Tombstones; }
+
+    // get the number of levels of the tree
+    SizeType Height() const { return Height(m_Root); }
+
+    /**
+     * @brief Counts the nodes at each depth.
+     * @param counts The counts to add to, one for each depth.
+     * @param depths The number of counts.
+     * @return The number of levels of the tree.
+     * 
+     * The root is at depth 1, and nodes deeper than the last count are
+     * added to it. Erased nodes that are waiting to be purged are
+     * counted too, since they still take up a level. The walk keeps its
+     * own stack, so a degenerate tree cannot overflow the call stack.
+     */
+    SizeType DepthHistogram(SizeType* counts, SizeType depths) const
+    {
+        return depths > 0 ? DepthHistogram(m_Root, counts, depths) : 0;
+    }
+
+    // get cursors at the minimum and maximum nodes, which are not valid
+    // when the tree is empty
+    Cursor CursorAtMin()
+    {
+        Cursor cursor(*this);
+        if (m_Root == nullptr) return cursor;
+
+        cursor.Enter(&m_Root);
+        cursor.DescendLeft();
+        cursor.SkipErased();
+        return cursor;
+    }
+
+    Cursor CursorAtMax()
+    {
+        Cursor cursor(*this);
+        if (m_Root == nullptr) return cursor;
+
+        cursor.Enter(&m_Root);
+        cursor.DescendRight();
+        cursor.SkipErasedBack();
+        return cursor;
+    }
+
+    /**
+     * @brief Gets a cursor at a key.
+     * @param key The key to search for.
+     * @return A cursor at the first node not less than key, which is
+     *         not valid when there is none.
+     * 
+     * Descends towards the key, and steps forward once when the
+     * descent ends before it, or at a lazily erased node.
+     */
+    Cursor CursorAt(const KeyType& key)
+    {
+        Cursor cursor(*this);
+
+        for (NodePointer* link = &m_Root; *link != nullptr; )
+        {
+            cursor.Enter(link);
+
+            if (key < KeyOf((*link)->data)) link = &(*link)->left;
+            else if (key > KeyOf((*link)->data)) link = &(*link)->right;
+            else break;
+        }
+
+        if ( cursor.Valid() && ( KeyOf(cursor.Data()) < key || IsErased(*cursor.m_Path.back()) ) )
+            cursor.Next();
+        return cursor;
+    }
+
+    // get minimum and maximum nodes of the tree
+    ConstReference Min() const { return m_LeftSpine.empty() ? Min(m_Root)->data : m_LeftSpine.back()->data; }
+    ConstReference Max() const { return m_RightSpine.empty() ? Max(m_Root)->data : m_RightSpine.back()->data; }
+
+    /**
+     * @brief Removes the minimum node.
+     * @return The data of the removed node.
+     * 
+     * Unlinks the minimum node through the cached left spine, so no
+     * descent from the root is needed. The tree must not be empty.
+     */
+    Pair PopMin()
+    {
+        LatencyTimer timer( Latency(Operation::Erase) );
+
+        Pair data = TakeMin();
+        Trace(Operation::Erase, KeyOf(data));
+        return data;
+    }
+
+    /**
+     * @brief Removes the maximum node.
+     * @return The data of the removed node.
+     * 
+     * Unlinks the maximum node through the cached right spine, so no
+     * descent from the root is needed. The tree must not be empty.
+     */
+    Pair PopMax()
+    {
+        LatencyTimer timer( Latency(Operation::Erase) );
+
+        Pair data = TakeMax();
+        Trace(Operation::Erase, KeyOf(data));
+        return data;
+    }
+
+    // find nodes in the tree
+    bool Contains(const KeyType& key) const
+    {
+        LatencyTimer timer( Latency(Operation::Find), m_Sampler != nullptr );
+        BST_PROBE1( find__entry, KeyHash(key) );
+        Trace(Operation::Find, key);
+
+        Descent descent;
+        ConstNodePointer node = m_Index ? IndexFind(key) : Find(key, m_Root, descent);
+        CountAccess(node);
+
+        BST_PROBE3( find__return, KeyHash(key), descent.depth, node != nullptr );
+        SampleSlow(Operation::Find, key, descent, timer);
+        return node != nullptr;
+    }
+
+    ValueType& Find(const KeyType& key)
+    {
+        LatencyTimer timer( Latency(Operation::Find), m_Sampler != nullptr );
+        BST_PROBE1( find__entry, KeyHash(key) );
+        Trace(Operation::Find, key);
+
+        // a node that may be shared is copied on the way down instead,
+        // after which it is owned, and can be found through the index
+        Descent descent;
+        NodePointer node = m_Index ? IndexFindOwned(key) : nullptr;
+        if (node == nullptr)
+        {
+            node = Find(key, m_Root, descent);
+            if (node) Index(node);
+        }
+        CountAccess(node);
+        UpdateSpines();
+
+        BST_PROBE3( find__return, KeyHash(key), descent.depth, node != nullptr );
+        SampleSlow(Operation::Find, key, descent, timer);
+        return ValueOf(node->data);
+    }
+
+    const ValueType& Find(const KeyType& key) const
+    {
+        LatencyTimer timer( Latency(Operation::Find), m_Sampler != nullptr );
+        BST_PROBE1( find__entry, KeyHash(key) );
+        Trace(Operation::Find, key);
+
+        Descent descent;
+        ConstNodePointer node = m_Index ? IndexFind(key) : Find(key, m_Root, descent);
+        CountAccess(node);
+
+        BST_PROBE3( find__return, KeyHash(key), descent.depth, node != nullptr );
+        SampleSlow(Operation::Find, key, descent, timer);
+        return ValueOf(node->data);
+    }
+
+    // find the closest nodes at or before, and at or after, a key
+    ConstPointer Predecessor(const KeyType& key) const
+    {
+        if (m_Tombstones == 0) return AsPointer( Predecessor(key, m_Root) );
+
+        // lazily erased nodes have to be stepped over in order
+        std::vector<ConstNodePointer> before, after;
+        Descend(key, before, after);
+
+        return AsPointer( NextBefore(before) );
+    }
+
+    ConstPointer Successor(const KeyType& key) const
+    {
+        if (m_Tombstones == 0) return AsPointer( Successor(key, m_Root) );
+
+        // lazily erased nodes have to be stepped over in order
+        std::vector<ConstNodePointer> before, after;
+        Descend(key, before, after);
+
+        // an exact match is the top of the nodes before the key
+        if ( !before.empty() && !(key > KeyOf(before.back()->data)) &&
+             !IsErased(before.back()) )
+            return &before.back()->data;
+
+        return AsPointer( NextAfter(after) );
+    }
+
+    /**
+     * @brief Finds the nodes nearest to a key.
+     * @param key The key to measure distance from.
+     * @param k The number of nodes to find.
+     * @return Up to k nodes, ordered by increasing key distance.
+     * 
+     * Descends once towards the key, remembering every left and right
+     * turn, then walks outwards in both directions. Ties are broken in
+     * favor of the smaller key. The key type must support subtraction.
+     * Lazily erased nodes are skipped.
+     */
+    std::vector<ConstPointer> NearestK(const KeyType& key, SizeType k) const
+    {
+        std::vector<ConstPointer> nearest;
+        std::vector<ConstNodePointer> before;
+        std::vector<ConstNodePointer> after;
+        Descend(key, before, after);
+
+        ConstNodePointer nextBefore = NextBefore(before);
+        ConstNodePointer nextAfter = NextAfter(after);
+
+        while ( nearest.size() < k && (nextBefore || nextAfter) )
+        {
+            bool takeBefore = nextAfter == nullptr ||
+                ( nextBefore != nullptr &&
+                  !(KeyOf(nextAfter->data) - key < key - KeyOf(nextBefore->data)) );
+
+            if (takeBefore)
+            {
+                nearest.push_back(&nextBefore->data);
+                nextBefore = NextBefore(before);
+            }
+            else
+            {
+                nearest.push_back(&nextAfter->data);
+                nextAfter = NextAfter(after);
+            }
+        }
+
+        return nearest;
+    }
+
+    // delete all the nodes in the tree
+    void Clear()
+    {
+        LatencyTimer timer( Latency(Operation::Clear) );
+        Trace(Operation::Clear);
+
+        Clear(m_Root);
+        m_Size = 0;
+        m_Tombstones = 0;
+        ResetSpines();
+        Reindex();
+    }
+
+    // insert a node into the tree
+    void Insert(ConstReference data)
+    {
+        LatencyTimer timer( Latency(Operation::Insert), m_Sampler != nullptr );
+        BST_PROBE1( insert__entry, KeyHash(KeyOf(data)) );
+        Trace( Operation::Insert, KeyOf(data), TraceValueSize(ValueOf(data)) );
+
+        Descent descent;
+        Insert(data, m_Root, descent);
+        UpdateSpines();
+
+        BST_PROBE3( insert__return, KeyHash(KeyOf(data)), descent.depth, descent.changed );
+        SampleSlow(Operation::Insert, KeyOf(data), descent, timer);
+    }
+
+    void Insert(Pair&& data)
+    {
+        LatencyTimer timer( Latency(Operation::Insert), m_Sampler != nullptr );
+        BST_PROBE1( insert__entry, KeyHash(KeyOf(data)) );
+        Trace( Operation::Insert, KeyOf(data), TraceValueSize(ValueOf(data)) );
+
+        // the data is moved, so its key is read back from the node
+        Descent descent;
+        Insert( std::move(data), m_Root, descent );
+        UpdateSpines();
+
+        BST_PROBE3( insert__return, KeyHash(KeyOf(descent.node->data)), descent.depth, descent.changed );
+        SampleSlow(Operation::Insert, KeyOf(descent.node->data), descent, timer);
+    }
+    
+    // remove a node from the tree
+    void Erase(KeyType key)
+    {
+        LatencyTimer timer( Latency(Operation::Erase), m_Sampler != nullptr );
+        BST_PROBE1( erase__entry, KeyHash(key) );
+        Trace(Operation::Erase, key);
+
+        Descent descent;
+        if (LAZY_ERASE && m_PurgeThreshold > 0) LazyErase(key, descent);
+        else EagerErase(key, descent);
+        UpdateSpines();
+
+        BST_PROBE3( erase__return, KeyHash(key), descent.depth, descent.changed );
+        SampleSlow(Operation::Erase, key, descent, timer);
+    }
+
+    /**
+     * @brief Sets up lazy erasing.
+     * @param purgeThreshold The number of erased nodes to allow before
+     *                       purging them, or zero to erase eagerly.
+     * 
+     * Lazily erased nodes are only marked, and are hidden from every
+     * query until they are purged all at once by Rebuild. The tree
+     * needs the BST_LAZY_ERASE feature.
+     */
+    void SetLazyErase(SizeType purgeThreshold)
+    {
+        static_assert(LAZY_ERASE, "lazy erasing needs the BST_LAZY_ERASE feature");
+
+        m_PurgeThreshold = purgeThreshold;
+        if (m_PurgeThreshold == 0) Purge();
+    }
+
+    // physically remove the lazily erased nodes
+    void Purge() { if (m_Tombstones > 0) Rebuild(); }
+
+    /**
+     * @brief Rebuilds the tree.
+     * 
+     * Relinks the nodes into a perfectly balanced tree, and deletes
+     * the lazily erased ones along the way.
+     */
+    void Rebuild()
+    {
+        std::vector<NodePointer> nodes;
+        nodes.reserve(m_Size);
+        std::vector<NodePointer> path;
+
+        // walk the tree in order, taking ownership of every node
+        NodePointer next = m_Root;
+        while (next || !path.empty())
+        {
+            for ( ; next != nullptr; next = next->left)
+            {
+                Unshare(next);
+                path.push_back(next);
+            }
+
+            NodePointer node = path.back();
+            path.pop_back();
+            next = node->right;
+
+            if (IsErased(node)) DeleteNode(node);
+            else nodes.push_back(node);
+        }
+
+        m_Root = Build(nodes, 0, nodes.size());
+        BST_PROBE2( rebuild, m_Size, m_Tombstones );
+        m_Tombstones = 0;
+        ResetSpines();
+        UpdateSpines();
+        Reindex();
+    }
+
+    /**
+     * @brief Builds a tree shaped by access weights.
+     * @param pairs The data of the new nodes, in any order.
+     * @param weights How often each pair is expected to be found.
+     * 
+     * Replaces the contents of the tree. Following Mehlhorn's
+     * bisection rule, the root of every subtree is the node whose
+     * share of the weight contains the subtree's halfway point, so a
+     * node of weight w is at most about log2(W / w) deep, where W is
+     * the total weight, and the expected depth of a find is within a
+     * small constant of the entropy of the weights. Each root is found
+     * by a binary search of the prefix sums, which takes O(n log n) in
+     * all. Subtrees without weight are balanced. When keys repeat, the
+     * first pair is kept, and the weights are added together.
+     */
+    void BuildOptimal(const std::vector<Pair>& pairs, const std::vector<double>& weights)
+    {
+        Clear();
+
+        std::vector<SizeType> order( pairs.size() );
+        for (SizeType i = 0; i < order.size(); ++i)
+            order[i] = i;
+
+        std::stable_sort( order.begin(), order.end(),
+                          [&pairs](SizeType a, SizeType b) { return KeyOf(pairs[a]) < KeyOf(pairs[b]); } );
+
+        // prefix[i] is the weight of every node before node i
+        std::vector<NodePointer> nodes;
+        std::vector<double> prefix(1, 0.0);
+        nodes.reserve( pairs.size() );
+        prefix.reserve(pairs.size() + 1);
+
+        for (SizeType i : order)
+        {
+            double weight = i < weights.size() ? weights[i] : 0.0;
+
+            if ( !nodes.empty() && !(KeyOf(nodes.back()->data) < KeyOf(pairs[i])) )
+            {
+                prefix.back() += weight;
+                continue;
+            }
+
+            nodes.push_back( NewNode(pairs[i]) );
+            prefix.push_back(prefix.back() + weight);
+        }
+
+        m_Size = nodes.size();
+        m_Root = Build(nodes, prefix, 0, nodes.size());
+        UpdateSpines();
+        Reindex();
+    }
+
+    /**
+     * @brief Compacts the memory of the tree.
+     * 
+     * Copies the nodes into a single block of a new pool, in the same
+     * shape, then releases the old nodes. The old pool returns all of
+     * its slabs once no other copy of the tree still uses it.
+     */
+    void Shrink()
+    {
+        if (m_Root == nullptr)
+        {
+            m_Pool.reset();
+            return;
+        }
+
+        std::shared_ptr<NodePool> pool = std::make_shared<NodePool>(m_Size + m_Tombstones);
+        NodePointer root = Copy(*pool, m_Root);
+        Clear(m_Root);
+        m_Pool = std::move(pool);
+        m_Root = root;
+        ResetSpines();
+        UpdateSpines();
+        Reindex();
+    }
+
+    /**
+     * @brief Packs the hottest nodes together in memory.
+     * @param profile The number of times each key was accessed, in any
+     *                order, such as the one from Accesses.
+     * 
+     * The heat of a node is the number of accesses that pass through
+     * it, which is the sum of the counts of its subtree. Nodes are
+     * copied into a single block of a new pool, hottest first, so the
+     * paths taken by most finds share a few cache lines and pages,
+     * and cold subtrees end up at the back. The shape of the tree is
+     * not changed, and the hit counts of the new nodes start over.
+     */
+    void Relayout(const AccessProfile& profile)
+    {
+        if (m_Root == nullptr) return;
+
+        AccessProfile counts(profile);
+        std::sort( counts.begin(), counts.end(),
+                   [](const std::pair<KeyType, std::uint64_t>& a, const std::pair<KeyType, std::uint64_t>& b)
+                   { return a.first < b.first; } );
+
+        std::vector<Weight> weights;
+        weights.reserve(m_Size + m_Tombstones);
+        SizeType cursor = 0;
+        Weigh(m_Root, counts, cursor, weights);
+
+        // place the hottest node whose parent is already placed, so
+        // nodes are laid out by heat, and after their parents
+        struct Placement
+        {
+            std::uint64_t heat;
+            SizeType index;
+            ConstNodePointer node;
+            NodePointer* link;
+
+            bool operator<(const Placement& other) const
+            {
+                return heat < other.heat || ( !(heat > other.heat) && index > other.index );
+            }
+        };
+
+        std::shared_ptr<NodePool> pool = std::make_shared<NodePool>(m_Size + m_Tombstones);
+        NodePointer root = nullptr;
+
+        std::priority_queue<Placement> frontier;
+        frontier.push( Placement{ weights[0].heat, 0, m_Root, &root } );
+
+        while ( !frontier.empty() )
+        {
+            Placement placement = frontier.top();
+            frontier.pop();
+
+            ConstNodePointer node = placement.node;
+            NodePointer copy = new ( pool->Allocate(false) ) BinaryNode(node->data);
+            SetErased( copy, IsErased(node) );
+            *placement.link = copy;
+
+            // in preorder, the left child comes next, and the right child
+            // comes after the whole left subtree
+            SizeType left = placement.index + 1;
+            SizeType right = left + ( node->left ? weights[left].size : 0 );
+
+            if (node->left) frontier.push( Placement{ weights[left].heat, left, node->left, &copy->left } );
+            if (node->right) frontier.push( Placement{ weights[right].heat, right, node->right, &copy->right } );
+        }
+
+        Clear(m_Root);
+        m_Pool = std::move(pool);
+        m_Root = root;
+        ResetSpines();
+        UpdateSpines();
+        Reindex();
+    }
+
+    // start or stop counting the hits of found nodes, which needs the
+    // BST_ACCESS_COUNTS feature
+    void EnableAccessCounting()
+    {
+        static_assert(ACCESS_COUNTS, "access counting needs the BST_ACCESS_COUNTS feature");
+        m_CountAccesses = true;
+    }
+
+    void DisableAccessCounting() { m_CountAccesses = false; }
+
+    /**
+     * @brief Gets the counted accesses.
+     * @return The hits of every node that was found, in key order.
+     * 
+     * Nodes are only counted while access counting is enabled, so
+     * the profile is empty without the BST_ACCESS_COUNTS feature.
+     */
+    AccessProfile Accesses() const
+    {
+        AccessProfile profile;
+        if (ACCESS_COUNTS) Accesses(m_Root, profile);
+        return profile;
+    }
+
+    /**
+     * @brief Starts indexing the nodes by hash.
+     * @param maxLoad The most slots of the index that can be full,
+     *                between 0 and 0.9. Lower loads take fewer probes
+     *                and more memory.
+     * 
+     * Contains and Find look keys up in the index in O(1) expected
+     * time, instead of descending the tree. Ordered queries still use
+     * the tree. The index takes 16 / maxLoad bytes per node on 64-bit
+     * targets. Copies of the tree share the index, and the first change
+     * to a copy clones it in O(n). A non-const Find descends the first
+     * time it finds a node that may still be shared with a copy, which
+     * copies the path to it.
+     */
+    void EnableHashIndex(double maxLoad = 0.5)
+    {
+        static_assert(HASHABLE, "hash indexes need keys with a std::hash");
+
+        m_Index = std::make_shared<HashIndex>( std::min(std::max(maxLoad, 0.01), 0.9) );
+        IndexNodes(false);
+    }
+
+    void DisableHashIndex() { m_Index.reset(); }
+
+    // get the memory used by the index, or zero when there is none
+    SizeType HashIndexBytes() const { return m_Index ? m_Index->Bytes() : 0; }
+
+    struct MemoryStats
+    {
+        SizeType liveBytes;
+        SizeType reservedBytes;
+    };
+
+    // get the memory used by nodes, and held by the pool for them
+    MemoryStats MemoryUsage() const
+    {
+        if (m_Pool == nullptr) return MemoryStats{0, 0};
+        return MemoryStats{ m_Pool->LiveBytes(), m_Pool->ReservedBytes() };
+    }
+
+    // start or stop recording operation latencies
+    void EnableStats() { if (m_Stats == nullptr) m_Stats = std::make_shared<OperationStats>(); }
+    void DisableStats() { m_Stats.reset(); }
+
+    // get the recorded latencies, or nullptr if they are not recorded
+    const OperationStats* Stats() const { return m_Stats.get(); }
+
+    /**
+     * @brief Starts sampling slow operations.
+     * @param latencyThreshold The latency, in ticks, that a find, insert
+     *                         or erase must exceed to be sampled.
+     * @param depthThreshold The depth it must exceed instead.
+     * @param capacity The number of samples to hold until they are popped.
+     * 
+     * Samples are shared with copies of the tree. When the ring of
+     * samples is full, new samples are dropped. The key type must be
+     * default constructible.
+     */
+    void EnableSlowSampling(std::uint64_t latencyThreshold, SizeType depthThreshold, SizeType capacity = 1024)
+    {
+        m_Sampler = std::make_shared<SlowSampler>(latencyThreshold, depthThreshold, capacity);
+    }
+
+    void DisableSlowSampling() { m_Sampler.reset(); }
+
+    // take the oldest slow operation sample, if there is one
+    bool PopSlowSample(SlowSample& sample) const { return m_Sampler && m_Sampler->samples.TryPop(sample); }
+    SizeType DroppedSlowSamples() const { return m_Sampler ? m_Sampler->samples.Dropped() : 0; }
+
+    /**
+     * @brief Starts tracing operations.
+     * @param recorder The recorder to write the trace.
+     * 
+     * Every insert, find, erase, copy and clear is recorded, along with
+     * the same operations on copies of the tree. The recorder is shared,
+     * so one trace can cover many trees.
+     */
+    void EnableTracing(std::shared_ptr< TraceRecorder<KeyType> > recorder) { m_Recorder = std::move(recorder); }
+    void DisableTracing() { m_Recorder.reset(); }
+
+    /**
+     * @brief Reports the recorded latencies.
+     * @param out The stream to print the report out.
+     * 
+     * Outputs the count and the p50, p99 and p999 latencies, in
+     * nanoseconds, of each operation.
+     */
+    void ReportLatency(std::ostream& out = std::cout) const
+    {
+        if (m_Stats == nullptr) return;
+
+        static const char* const NAMES[OPERATION_COUNT] = { "Insert", "Find", "Erase", "Copy", "Clear" };
+        double ticksPerNanosecond = LatencyTicksPerNanosecond();
+
+        for (SizeType i = 0; i < OPERATION_COUNT; ++i)
+        {
+            const LatencyHistogram& latency = m_Stats->latency[i];
+
+            out << NAMES[i] << ": count=" << latency.Count()
+                << " p50=" << latency.Quantile(0.5) / ticksPerNanosecond << "ns"
+                << " p99=" << latency.Quantile(0.99) / ticksPerNanosecond << "ns"
+                << " p999=" << latency.Quantile(0.999) / ticksPerNanosecond << "ns\n";
+        }
+    }
+
+    /**
+     * @brief In order traversal.
+     * @param visit Called with the data of each node, in key order.
+     * 
+     * Walks down the left children with a stack, so deep trees cannot
+     * overflow the call stack. Lazily erased nodes are skipped.
+     */
+    template<typename Function>
+    void ForEach(Function visit) const
+    {
+        std::vector<ConstNodePointer> path;
+        ConstNodePointer next = m_Root;
+
+        while ( next != nullptr || !path.empty() )
+        {
+            for ( ; next != nullptr; next = next->left)
+                path.push_back(next);
+
+            ConstNodePointer node = path.back();
+            path.pop_back();
+            next = node->right;
+
+            if (!IsErased(node)) visit(node->data);
+        }
+    }
+
+    /**
+     * @brief In order traversal of a range.
+     * @param key The key to start at.
+     * @param count The most nodes to visit.
+     * @param visit Called with the data of each node, in key order.
+     * @return The number of nodes visited.
+     * 
+     * Visits the nodes from the first one not less than key. It
+     * descends once, and then steps from node to node, so visiting k
+     * nodes takes one descent and k steps. Lazily erased nodes are
+     * skipped.
+     */
+    template<typename Function>
+    SizeType ForEachFrom(const KeyType& key, SizeType count, Function visit) const
+    {
+        std::vector<ConstNodePointer> before, after;
+        Descend(key, before, after);
+
+        SizeType visited = 0;
+
+        // an exact match is the top of the nodes before the key
+        if ( count > 0 && !before.empty() && !(key > KeyOf(before.back()->data)) &&
+             !IsErased(before.back()) )
+        {
+            visit(before.back()->data);
+            ++visited;
+        }
+
+        for ( ; visited < count; ++visited)
+        {
+            ConstNodePointer node = NextAfter(after);
+            if (node == nullptr) break;
+
+            visit(node->data);
+        }
+
+        return visited;
+    }
+
+    // used in LevelByLevel
+    static constexpr NodePointer DELIMETER = nullptr;
+
+    /**
+     * @brief Level by level traversal.
+     * @param out The stream to print the tree out.
+     * 
+     * Outputs the nodes in each level of the tree.
+     */
+    void LevelByLevel(std::ostream& out = std::cout) const
+    {
+        if (m_Root == nullptr) return;
+
+        std::queue<ConstNodePointer> q;
+        q.push(m_Root);
+        q.push(DELIMETER);
+
+        while (1)
+        {
+            ConstNodePointer curr = q.front();
+            q.pop();
+
+            // the current level has been traversed
+            if (curr == DELIMETER)
+            {
+                out << '\n';
+                
+                if (q.empty()) break;
+                q.push(DELIMETER);
+            }
+
+            // the current level is still being traversed
+            else
+            {
+                if (!IsErased(curr)) out << ValueOf(curr->data) << ' ';
+
+                // push children nodes for the next level
+                if (curr->left) q.push(curr->left);
+                if (curr->right) q.push(curr->right);
+            }
+        }
+    }
+
+private:
+    /**
+     * @brief Finds the minimum node.
+     * @param node The root of the tree to find the minimum key in.
+     * @return The minimum node.
+     * 
+     * Finds the node with the smallest key value.
+     */
+    ConstNodePointer Min(ConstNodePointer node) const
+    {
+        if (node == nullptr) return nullptr;
+
+        // the minimum is the furthest left child
+        while (node->left)
+            node = node->left;
+        
+        return node;
+    }
+
+    /**
+     * @brief Finds the maximum node.
+     * @param node The root of the tree to find the maximum key in.
+     * @return The maximum node.
+     * 
+     * Finds the node with the largest key value.
+     */
+    ConstNodePointer Max(ConstNodePointer node) const
+    {
+        if (node == nullptr) return nullptr;
+
+        // the maximum is the furthest right child
+        while (node->right)
+            node = node->right;
+        
+        return node;
+    }
+
+    /**
+     * @brief Unlinks the minimum node.
+     * @return The unlinked node.
+     * 
+     * Replaces the minimum node with its right subtree, and extends
+     * the left spine to the new minimum.
+     */
+    NodePointer UnlinkMin()
+    {
+        OwnLeftSpine();
+
+        NodePointer node = m_LeftSpine.back();
+        m_LeftSpine.pop_back();
+
+        // the minimum has no left child, so its right subtree takes its place
+        if ( m_LeftSpine.empty() )
+        {
+            m_Root = node->right;
+            m_RightSpine.clear();
+            m_RightSpineOwned = false;
+        }
+        else m_LeftSpine.back()->left = node->right;
+
+        NodePointer& link = m_LeftSpine.empty() ? m_Root : m_LeftSpine.back()->left;
+
+        // the new minimum is the furthest left child of that subtree
+        for (NodePointer* child = &link; *child != nullptr; child = &(*child)->left)
+        {
+            Unshare(*child);
+            m_LeftSpine.push_back(*child);
+        }
+
+        return node;
+    }
+
+    /**
+     * @brief Unlinks the maximum node.
+     * @return The unlinked node.
+     * 
+     * Replaces the maximum node with its left subtree, and extends
+     * the right spine to the new maximum.
+     */
+    NodePointer UnlinkMax()
+    {
+        OwnRightSpine();
+
+        NodePointer node = m_RightSpine.back();
+        m_RightSpine.pop_back();
+
+        // the maximum has no right child, so its left subtree takes its place
+        if ( m_RightSpine.empty() )
+        {
+            m_Root = node->left;
+            m_LeftSpine.clear();
+            m_LeftSpineOwned = false;
+        }
+        else m_RightSpine.back()->right = node->left;
+
+        NodePointer& link = m_RightSpine.empty() ? m_Root : m_RightSpine.back()->right;
+
+        // the new maximum is the furthest right child of that subtree
+        for (NodePointer* child = &link; *child != nullptr; child = &(*child)->right)
+        {
+            Unshare(*child);
+            m_RightSpine.push_back(*child);
+        }
+
+        return node;
+    }
+
+    /**
+     * @brief Removes the minimum node, without timing or tracing it.
+     * @return The data of the removed node.
+     * 
+     * This is PopMin for erases, which are timed and traced themselves.
+     */
+    Pair TakeMin()
+    {
+        NodePointer node = UnlinkMin();
+        Unindex(node);
+        Pair data = std::move(node->data);
+        DeleteNode(node);
+        --m_Size;
+
+        PurgeErasedMin();
+        UpdateSpines();
+        return data;
+    }
+
+    // the same for the maximum
+    Pair TakeMax()
+    {
+        NodePointer node = UnlinkMax();
+        Unindex(node);
+        Pair data = std::move(node->data);
+        DeleteNode(node);
+        --m_Size;
+
+        PurgeErasedMax();
+        UpdateSpines();
+        return data;
+    }
+
+    // purge lazily erased nodes that have become the minimum or maximum
+    void PurgeErasedMin()
+    {
+        while ( m_Tombstones > 0 && !m_LeftSpine.empty() && IsErased(m_LeftSpine.back()) )
+        {
+            NodePointer erased = UnlinkMin();
+            Unindex(erased);
+            DeleteNode(erased);
+            --m_Tombstones;
+        }
+    }
+
+    void PurgeErasedMax()
+    {
+        while ( m_Tombstones > 0 && !m_RightSpine.empty() && IsErased(m_RightSpine.back()) )
+        {
+            NodePointer erased = UnlinkMax();
+            Unindex(erased);
+            DeleteNode(erased);
+            --m_Tombstones;
+        }
+    }
+
+    /**
+     * @brief Erases a node right away.
+     * @param key The key of the node to delete.
+     * @param descent The path taken to the node.
+     * 
+     * The minimum and maximum are unlinked through their spines, so a
+     * loop that erases the minimum never descends from the root. Any
+     * other node is found by a descent, which splices it out of the
+     * spines it is on.
+     */
+    void EagerErase(const KeyType& key, Descent& descent)
+    {
+        if (m_Root == nullptr) return;
+
+        if ( !m_LeftSpine.empty() && IsKey(m_LeftSpine.back(), key) ) TakeMin();
+        else if ( !m_RightSpine.empty() && IsKey(m_RightSpine.back(), key) ) TakeMax();
+        else
+        {
+            Erase(key, m_Root, descent);
+            return;
+        }
+
+        descent.changed = true;
+    }
+
+    /**
+     * @brief Marks a node as erased.
+     * @param key The key of the node to erase.
+     * @param descent The path taken to the node.
+     * 
+     * The minimum and maximum are always removed for real, so that
+     * Min and Max never have to step over erased nodes.
+     */
+    void LazyErase(const KeyType& key, Descent& descent)
+    {
+        if (m_Root == nullptr) return;
+
+        if ( !(key > KeyOf(Min())) )
+        {
+            descent.changed = !(key < KeyOf(Min()));
+            if (descent.changed) TakeMin();
+            return;
+        }
+
+        if ( !(key < KeyOf(Max())) )
+        {
+            descent.changed = !(key > KeyOf(Max()));
+            if (descent.changed) TakeMax();
+            return;
+        }
+
+        NodePointer node = Find(key, m_Root, descent);
+        if (node == nullptr) return;
+
+        SetErased(node, true);
+        descent.changed = true;
+        --m_Size;
+        ++m_Tombstones;
+
+        if (m_Tombstones > m_PurgeThreshold) Rebuild();
+    }
+
+    /**
+     * @brief Builds a balanced tree.
+     * @param nodes The nodes to link, in order.
+     * @param first The index of the first node of the tree.
+     * @param last The index after the last node of the tree.
+     * @return The root of the new tree.
+     * 
+     * Recursively links the middle node to the halves on either side.
+     */
+    static NodePointer Build(const std::vector<NodePointer>& nodes, SizeType first, SizeType last)
+    {
+        if (first == last) return nullptr;
+
+        SizeType middle = first + (last - first) / 2;
+        NodePointer root = nodes[middle];
+        root->left = Build(nodes, first, middle);
+        root->right = Build(nodes, middle + 1, last);
+
+        return root;
+    }
+
+    /**
+     * @brief Builds a tree shaped by weight.
+     * @param nodes The nodes to link, in order.
+     * @param prefix The weight before each node, and the total weight.
+     * @param first The index of the first node of the tree.
+     * @param last The index after the last node of the tree.
+     * @return The root of the new tree.
+     * 
+     * Recursively links the node that straddles the middle of the
+     * weight to the subtrees on either side.
+     */
+    static NodePointer Build( const std::vector<NodePointer>& nodes,
+                              const std::vector<double>& prefix,
+                              SizeType first,
+                              SizeType last )
+    {
+        if (first == last) return nullptr;
+
+        SizeType middle = first + (last - first) / 2;
+        double weight = prefix[last] - prefix[first];
+
+        // the node whose weight covers the halfway point is the first
+        // one whose end is past it
+        if (weight > 0)
+        {
+            double half = prefix[first] + weight / 2;
+            middle = std::upper_bound(prefix.begin() + first + 1, prefix.begin() + last + 1, half) - prefix.begin() - 1;
+        }
+
+        NodePointer root = nodes[middle];
+        root->left = Build(nodes, prefix, first, middle);
+        root->right = Build(nodes, prefix, middle + 1, last);
+
+        return root;
+    }
+
+    /**
+     * @brief Brings the cached spines up to date.
+     * 
+     * Rebuilds an invalidated spine, and otherwise extends it to a new
+     * minimum or maximum. A new minimum is always inserted as the left
+     * child of the old one, and a new maximum as the right child.
+     */
+    void UpdateSpines()
+    {
+        if ( m_LeftSpine.empty() )
+        {
+            for (NodePointer node = m_Root; node != nullptr; node = node->left)
+                m_LeftSpine.push_back(node);
+        }
+        else if ( m_LeftSpine.back()->left )
+            m_LeftSpine.push_back(m_LeftSpine.back()->left);
+
+        if ( m_RightSpine.empty() )
+        {
+            for (NodePointer node = m_Root; node != nullptr; node = node->right)
+                m_RightSpine.push_back(node);
+        }
+        else if ( m_RightSpine.back()->right )
+            m_RightSpine.push_back(m_RightSpine.back()->right);
+    }
+
+    /**
+     * @brief Takes ownership of the path to the minimum node.
+     * 
+     * Rebuilds the left spine, copying any shared node on it, so that
+     * PopMin can unlink nodes in place.
+     */
+    void OwnLeftSpine()
+    {
+        if ( m_LeftSpineOwned && !m_LeftSpine.empty() ) return;
+
+        m_LeftSpine.clear();
+        for (NodePointer* node = &m_Root; *node != nullptr; node = &(*node)->left)
+        {
+            // a copied root is no longer on the cached right spine
+            if ( Unshare(*node) && node == &m_Root )
+            {
+                m_RightSpine.clear();
+                m_RightSpineOwned = false;
+            }
+
+            m_LeftSpine.push_back(*node);
+        }
+
+        m_LeftSpineOwned = true;
+    }
+
+    /**
+     * @brief Takes ownership of the path to the maximum node.
+     * 
+     * Rebuilds the right spine, copying any shared node on it, so that
+     * PopMax can unlink nodes in place.
+     */
+    void OwnRightSpine()
+    {
+        if ( m_RightSpineOwned && !m_RightSpine.empty() ) return;
+
+        m_RightSpine.clear();
+        for (NodePointer* node = &m_Root; *node != nullptr; node = &(*node)->right)
+        {
+            // a copied root is no longer on the cached left spine
+            if ( Unshare(*node) && node == &m_Root )
+            {
+                m_LeftSpine.clear();
+                m_LeftSpineOwned = false;
+            }
+
+            m_RightSpine.push_back(*node);
+        }
+
+        m_RightSpineOwned = true;
+    }
+
+    /**
+     * @brief Splices an unlinked node out of the spines.
+     * @param node The node that was unlinked.
+     * @param link The link that took its only child, or nullptr.
+     * @param depth The depth the node was at, where the root is at 0.
+     * 
+     * A node can only be on a spine at its own depth. The end of a
+     * spine is replaced by the path down its child's subtree, and any
+     * other node on it by its child, which is already next.
+     */
+    void SpliceSpines(ConstNodePointer node, NodePointer& link, SizeType depth)
+    {
+        if ( depth < m_LeftSpine.size() && m_LeftSpine[depth] == node )
+        {
+            m_LeftSpine.erase(m_LeftSpine.begin() + depth);
+
+            if ( depth == m_LeftSpine.size() )
+            {
+                for (NodePointer* child = &link; *child != nullptr; child = &(*child)->left)
+                {
+                    // a copied root is no longer on the cached right spine
+                    if ( Unshare(*child) && child == &m_Root )
+                    {
+                        m_RightSpine.clear();
+                        m_RightSpineOwned = false;
+                    }
+
+                    m_LeftSpine.push_back(*child);
+                }
+            }
+        }
+
+        if ( depth < m_RightSpine.size() && m_RightSpine[depth] == node )
+        {
+            m_RightSpine.erase(m_RightSpine.begin() + depth);
+
+            if ( depth == m_RightSpine.size() )
+            {
+                for (NodePointer* child = &link; *child != nullptr; child = &(*child)->right)
+                {
+                    // a copied root is no longer on the cached left spine
+                    if ( Unshare(*child) && child == &m_Root )
+                    {
+                        m_LeftSpine.clear();
+                        m_LeftSpineOwned = false;
+                    }
+
+                    m_RightSpine.push_back(*child);
+                }
+            }
+        }
+    }
+
+    // put a node in the place of another on the spines, at its depth
+    void ReplaceOnSpines(ConstNodePointer node, NodePointer replacement, SizeType depth)
+    {
+        if ( depth < m_LeftSpine.size() && m_LeftSpine[depth] == node ) m_LeftSpine[depth] = replacement;
+        if ( depth < m_RightSpine.size() && m_RightSpine[depth] == node ) m_RightSpine[depth] = replacement;
+    }
+
+    // invalidate the cached spines
+    void ResetSpines()
+    {
+        m_LeftSpine.clear();
+        m_RightSpine.clear();
+        DisownSpines();
+    }
+
+    // mark the cached spines as possibly shared with another tree
+    void DisownSpines() const
+    {
+        m_LeftSpineOwned.store(false, std::memory_order_relaxed);
+        m_RightSpineOwned.store(false, std::memory_order_relaxed);
+    }
+
+    // the accesses passing through a node, and the size of its subtree
+    struct Weight
+    {
+        std::uint64_t heat;
+        SizeType size;
+    };
+
+    /**
+     * @brief Weighs the nodes of a tree.
+     * @param node The root of the tree to weigh.
+     * @param profile The access counts, sorted by key.
+     * @param cursor The first count not yet matched to a node.
+     * @param weights The weight of every node, in preorder.
+     * @return The weight of the tree.
+     * 
+     * Walks the tree in order alongside the counts, giving each node
+     * the counts of its key, and then the heat of its children.
+     */
+    static Weight Weigh( ConstNodePointer node,
+                         const AccessProfile& profile,
+                         SizeType& cursor,
+                         std::vector<Weight>& weights )
+    {
+        if (node == nullptr) return Weight{0, 0};
+
+        SizeType index = weights.size();
+        weights.push_back( Weight{0, 1} );
+
+        Weight left = Weigh(node->left, profile, cursor, weights);
+
+        // counts of keys that are not in the tree are skipped
+        std::uint64_t hits = 0;
+        while ( cursor < profile.size() && profile[cursor].first < KeyOf(node->data) )
+            ++cursor;
+        while ( cursor < profile.size() && !(KeyOf(node->data) < profile[cursor].first) )
+            hits += profile[cursor++].second;
+
+        Weight right = Weigh(node->right, profile, cursor, weights);
+
+        weights[index] = Weight{ hits + left.heat + right.heat, 1 + left.size + right.size };
+        return weights[index];
+    }
+
+    // add the hits of a tree's nodes to a profile, in key order
+    static void Accesses(ConstNodePointer node, AccessProfile& profile)
+    {
+        if (node == nullptr) return;
+
+        Accesses(node->left, profile);
+
+        std::uint32_t hits = Hits(node);
+        if (hits > 0 && !IsErased(node)) profile.emplace_back(KeyOf(node->data), hits);
+
+        Accesses(node->right, profile);
+    }
+
+    /**
+     * @brief Finds the height of a tree.
+     * @param node The root of the tree.
+     * @return The number of levels of the tree.
+     * 
+     * Recursively finds the taller of the two subtrees.
+     */
+    static SizeType Height(ConstNodePointer node)
+    {
+        if (node == nullptr) return 0;
+
+        SizeType left = Height(node->left);
+        SizeType right = Height(node->right);
+
+        return 1 + (left > right ? left : right);
+    }
+
+    /**
+     * @brief Counts the nodes at each depth of a tree.
+     * @param root The root of the tree.
+     * @param counts The counts to add to, one for each depth.
+     * @param depths The number of counts.
+     * @return The number of levels of the tree.
+     * 
+     * Counts each node as it is popped from a stack of the nodes still
+     * to visit, along with their depths.
+     */
+    static SizeType DepthHistogram(ConstNodePointer root, SizeType* counts, SizeType depths)
+    {
+        SizeType height = 0;
+        std::vector< std::pair<ConstNodePointer, SizeType> > stack;
+        if (root) stack.emplace_back(root, 0);
+
+        while ( !stack.empty() )
+        {
+            ConstNodePointer node = stack.back().first;
+            SizeType depth = stack.back().second;
+            stack.pop_back();
+
+            ++counts[depth < depths ? depth : depths - 1];
+            if (depth + 1 > height) height = depth + 1;
+
+            if (node->left) stack.emplace_back(node->left, depth + 1);
+            if (node->right) stack.emplace_back(node->right, depth + 1);
+        }
+
+        return height;
+    }
+
+    /**
+     * @brief Samples an operation if it was slow.
+     * @param operation The operation that was performed.
+     * @param key The key that the operation descended towards.
+     * @param descent The path taken by the operation.
+     * @param timer The timer started by the operation.
+     * 
+     * Records the operation when it exceeded either threshold.
+     */
+    void SampleSlow( Operation operation,
+                     const KeyType& key,
+                     const Descent& descent,
+                     const LatencyTimer& timer ) const
+    {
+        if (m_Sampler == nullptr) return;
+
+        std::uint64_t ticks = timer.Elapsed();
+        if ( ticks <= m_Sampler->latencyThreshold && descent.depth <= m_Sampler->depthThreshold )
+            return;
+
+        m_Sampler->samples.TryPush( SlowSample{ key, operation, descent.depth, descent.turns, ticks } );
+    }
+
+    // record an operation in the trace, if there is one
+    void Trace(Operation operation, const KeyType& key, std::uint32_t valueSize = 0) const
+    {
+        if (m_Recorder) m_Recorder->Record(static_cast<std::uint8_t>(operation), key, valueSize);
+    }
+
+    // operations without a key are traced with a default key, when the
+    // key type has one
+    void Trace(Operation operation) const { TraceWithoutKey( operation, std::is_default_constructible<KeyType>() ); }
+    void TraceWithoutKey(Operation operation, std::true_type) const { Trace( operation, KeyType() ); }
+    void TraceWithoutKey(Operation, std::false_type) const { }
+
+    // find a node through the index, skipping lazily erased ones, and
+    // nodes that may be shared with a copy when they are to be changed
+    NodePointer IndexFind(const KeyType& key) const
+    {
+        NodePointer node = m_Index->Find(key);
+        return node && !IsErased(node) ? node : nullptr;
+    }
+
+    NodePointer IndexFindOwned(const KeyType& key) const
+    {
+        NodePointer node = m_Index->FindOwned(key);
+        return node && !IsErased(node) ? node : nullptr;
+    }
+
+    // add or remove a node owned by this tree alone, if there is an index
+    void Index(NodePointer node) { if ( OwnIndex() ) m_Index->Insert(node, true); }
+    void Unindex(ConstNodePointer node) { if ( OwnIndex() ) m_Index->Remove(node); }
+
+    // clone the index before changing it, if a copy of the tree shares it
+    bool OwnIndex()
+    {
+        if (m_Index == nullptr) return false;
+        if (m_Index.use_count() > 1) m_Index = std::make_shared<HashIndex>(*m_Index);
+        return true;
+    }
+
+    // index the nodes again after they were replaced wholesale, which
+    // leaves every node owned by this tree alone
+    void Reindex() { IndexNodes(true); }
+
+    /**
+     * @brief Empties the index, and adds every node to it.
+     * @param owned Whether every node is owned by this tree alone.
+     * 
+     * An index shared with a copy is replaced rather than cleared.
+     */
+    void IndexNodes(bool owned)
+    {
+        if (m_Index == nullptr) return;
+
+        if (m_Index.use_count() > 1) m_Index = std::make_shared<HashIndex>( m_Index->MaxLoad() );
+        m_Index->Reset(m_Size + m_Tombstones);
+        std::vector<NodePointer> path;
+        if (m_Root) path.push_back(m_Root);
+
+        while ( !path.empty() )
+        {
+            NodePointer node = path.back();
+            path.pop_back();
+            m_Index->Insert(node, owned);
+
+            if (node->left) path.push_back(node->left);
+            if (node->right) path.push_back(node->right);
+        }
+    }
+
+    // count a hit on a found node, if accesses are being counted
+    void CountAccess(ConstNodePointer node) const
+    {
+        if constexpr (ACCESS_COUNTS)
+        {
+            if (m_CountAccesses && node) node->hits.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+
+    // get the hits counted on a node
+    static std::uint32_t Hits(ConstNodePointer node)
+    {
+        if constexpr (ACCESS_COUNTS) return node->hits.load(std::memory_order_relaxed);
+        else return 0;
+    }
+
+    // get or set whether a node was lazily erased, which it never is
+    // without the BST_LAZY_ERASE feature
+    static bool IsErased(ConstNodePointer node)
+    {
+        if constexpr (LAZY_ERASE) return node->erased;
+        else return false;
+    }
+
+    static void SetErased(NodePointer node, bool erased)
+    {
+        if constexpr (LAZY_ERASE) node->erased = erased;
+    }
+
+    // whether a node holds a key
+    static bool IsKey(ConstNodePointer node, const KeyType& key)
+    {
+        return !(key < KeyOf(node->data)) && !(key > KeyOf(node->data));
+    }
+
+    // get the key and the value of a node's data
+    static auto KeyOf(const Pair& data) -> decltype( Data::Key(data) ) { return Data::Key(data); }
+    static ValueType& ValueOf(Pair& data) { return Data::Value(data); }
+    static const ValueType& ValueOf(const Pair& data) { return Data::Value(data); }
+
+    // hash a key for the tracepoints
+    static std::size_t KeyHash(const KeyType& key) { return std::hash<KeyType>()(key); }
+
+    // get the histogram of an operation, or nullptr if it is not recorded
+    LatencyHistogram* Latency(Operation operation) const
+    {
+        return m_Stats ? &m_Stats->latency[ static_cast<SizeType>(operation) ] : nullptr;
+    }
 
     /**
-     * @brief Initialize constructor.
-     * @param data The data of the root.
+     * @brief Creates a node.
+     * @param args The arguments of the node's constructor.
+     * @return The new node.
      * 
-     * Creates a tree with data in the root.
+     * Constructs a node in a slot of the pool, creating the pool first
+     * if the tree has none.
      */
-    BinarySearchTree(ConstReference data)
-        : m_Root( new BinaryNode(data) ),
-          m_Size(1)
-    { }
+    template<typename... Args>
+    NodePointer NewNode(Args&&... args)
+    {
+        if (m_Pool == nullptr) m_Pool = std::make_shared<NodePool>();
+
+        NodePointer node = new ( m_Pool->Allocate( PoolShared() ) ) BinaryNode( std::forward<Args>(args)... );
+        BST_PROBE2( node__alloc, node, sizeof(BinaryNode) );
+
+        return node;
+    }
+
+    // destruct a node, and return its slot to the pool
+    void DeleteNode(NodePointer node)
+    {
+        node->~BinaryNode();
+        m_Pool->Deallocate( node, PoolShared() );
+    }
 
     /**
-     * @brief Copy constructor.
-     * @param other The tree to copy.
+     * @brief Gets whether another tree uses the pool.
      * 
-     * Creates a new tree by copying the contents of the other.
+     * The last copy to let go of the pool does so with a release, so
+     * the fence makes its frees visible before the pool is used
+     * without the lock.
      */
-    BinarySearchTree(const BinarySearchTree& other)
-        : m_Root( Copy(other.m_Root) ),
-          m_Size(other.m_Size)
-    { }
+    bool PoolShared() const
+    {
+        if (m_Pool.use_count() > 1) return true;
+
+        std::atomic_thread_fence(std::memory_order_acquire);
+        return false;
+    }
 
     /**
-     * @brief Move constructor.
-     * @param other The tree to move.
+     * @brief Copies the nodes of another tree.
+     * @param other The tree being copied.
      * 
-     * Creates a new tree by moving the contents of the other.
+     * Shares the root of the other tree, or copies every node when
+     * nodes cannot be shared, and indexes the copies.
      */
-    BinarySearchTree(BinarySearchTree&& other)
-        : m_Root(other.m_Root),
-          m_Size(other.m_Size)
+    void CopyNodes(const BinarySearchTree& other)
     {
-        other.m_Root = nullptr;
-        other.m_Size = 0;
+        if constexpr (SHARED_NODES)
+        {
+            m_Root = Share(other.m_Root);
+            other.DisownSpines();
+            other.m_Copies.fetch_add(1, std::memory_order_relaxed);
+            if (m_Index) m_Index->Disown();
+        }
+        else if (other.m_Root)
+        {
+            if (m_Pool == nullptr) m_Pool = std::make_shared<NodePool>(other.m_Size + other.m_Tombstones);
+            m_Root = Copy(*m_Pool, other.m_Root);
+            UpdateSpines();
+            Reindex();
+        }
     }
 
-    ~BinarySearchTree() { Clear(m_Root); }
-
     /**
-     * @brief Copy assignment operator.
-     * @param other The tree to copy.
+     * @brief Copies a tree.
+     * @param pool The pool to allocate the new nodes from.
+     * @param node The current node to copy.
+     * @return The root of the new tree.
      * 
-     * Recreates the tree by copying the contents of the other.
+     * Recursively copies the nodes of a tree.
      */
-    BinarySearchTree& operator=(const BinarySearchTree& other)
+    static NodePointer Copy(NodePool& pool, ConstNodePointer node)
     {
-        if (this == &other) return *this;
+        if (node == nullptr) return nullptr;
 
-        Clear();
-        m_Root = Copy(other.m_Root);
-        m_Size = other.m_Size;
+        // copy the node and its children
+        NodePointer root = new ( pool.Allocate(false) ) BinaryNode(node->data);
+        SetErased( root, IsErased(node) );
+        root->left = Copy(pool, node->left);
+        root->right = Copy(pool, node->right);
 
-        return *this;
+        return root;
     }
 
     /**
-     * @brief Move assignment operator.
-     * @param other The tree to move.
+     * @brief Shares a tree.
+     * @param node The root of the tree to share.
+     * @return The same root.
      * 
-     * Recreates the tree by moving the contents of the other.
+     * Adds a reference to the root, so that the whole tree is shared.
+     * Nodes are never shared without the BST_SHARED_NODES feature.
      */
-    BinarySearchTree& operator=(BinarySearchTree&& other)
+    static NodePointer Share(NodePointer node)
     {
-        if (this == &other) return *this;
-
-        Clear();
-        m_Root = other.m_Root;
-        m_Size = other.m_Size;
-        other.m_Root = nullptr;
-        other.m_Size = 0;
-
-        return *this;
+        if constexpr (SHARED_NODES)
+        {
+            if (node) node->refs.fetch_add(1, std::memory_order_relaxed);
+        }
+        return node;
     }
 
-    // private member data getters
-    ConstReference Root() const { return ConstReference(m_Root->data); }
-    SizeType Size() const { return m_Size; }
-    bool Empty() const { return m_Size == 0; }
+    /**
+     * @brief Makes a node owned by this tree alone.
+     * @param node The node to unshare.
+     * @return Whether the node was copied.
+     * 
+     * Replaces a shared node with a copy that shares its children, so
+     * the copy can be changed without affecting other trees.
+     */
+    bool Unshare(NodePointer& node)
+    {
+        if constexpr (!SHARED_NODES) return false;
+        if ( RefCount(node) == 1 ) return false;
 
-    // get minimum and maximum nodes of the tree
-    ConstReference Min() const { return Min(m_Root)->data; }
-    ConstReference Max() const { return Max(m_Root)->data; }
+        NodePointer copy = NewNode( node->data, Share(node->left), Share(node->right) );
+        SetErased( copy, IsErased(node) );
+        Index(copy);
+        Release(node);
+        node = copy;
 
-    // find nodes in the tree
-    bool Contains(const KeyType& key) const { return Find(key, m_Root) != nullptr; }
-    ValueType& Find(const KeyType& key) { return Find(key, m_Root)->data.second; }
-    const ValueType& Find(const KeyType& key) const { return Find(key, m_Root)->data.second; }
+        return true;
+    }
 
-    // delete all the nodes in the tree
-    void Clear()
+    // get the references to a node, or drop one and get how many there
+    // were, which is always one without the BST_SHARED_NODES feature
+    static SizeType RefCount(ConstNodePointer node)
     {
-        Clear(m_Root);
-        m_Size = 0;
+        if constexpr (SHARED_NODES) return node->refs.load(std::memory_order_acquire);
+        else return 1;
     }
 
-    // insert a node into the tree
-    void Insert(ConstReference data) { Insert(data, m_Root); }
-    void Insert(Pair&& data) { Insert( std::move(data), m_Root ); }
-    
-    // remove a node from the tree
-    void Erase(KeyType key) { Erase(key, m_Root); }
-
-    // used in LevelByLevel
-    static constexpr NodePointer DELIMETER = nullptr;
+    static SizeType Unref(NodePointer node)
+    {
+        if constexpr (SHARED_NODES) return node->refs.fetch_sub(1, std::memory_order_acq_rel);
+        else return 1;
+    }
 
     /**
-     * @brief Level by level traversal.
-     * @param out The stream to print the tree out.
+     * @brief Deletes a tree.
+     * @param node The root of the tree to delete.
      * 
-     * Outputs the nodes in each level of the tree.
+     * Drops a reference to the root, and recursively destructs the
+     * nodes that are no longer shared with another tree.
      */
-    void LevelByLevel(std::ostream& out = std::cout) const
+    void Release(NodePointer node)
     {
-        if (m_Root == nullptr) return;
+        if (node == nullptr) return;
 
-        std::queue<ConstNodePointer> q;
-        q.push(m_Root);
-        q.push(DELIMETER);
+        // a node owned by this tree alone does not need an atomic decrement
+        if ( RefCount(node) != 1 && Unref(node) != 1 )
+            return;
 
-        while (1)
-        {
-            ConstNodePointer curr = q.front();
-            q.pop();
+        // delete a node's children before itself
+        Release(node->left);
+        Release(node->right);
 
-            // the current level has been traversed
-            if (curr == DELIMETER)
-            {
-                out << '\n';
-                
-                if (q.empty()) break;
-                q.push(DELIMETER);
-            }
+        DeleteNode(node);
+    }
 
-            // the current level is still being traversed
-            else
-            {
-                out << curr->data.second << ' ';
+    /**
+     * @brief Finds a node in the tree.
+     * @param key The key of the node to find.
+     * @param node The root of the tree to find in.
+     * @param descent The path taken to the node.
+     * @return The node with the key value.
+     * 
+     * Finds the node with a certain key value in the tree, and takes
+     * ownership of the path to it so its value can be changed.
+     */
+    NodePointer Find(const KeyType& key, NodePointer& node, Descent& descent)
+    {
+        if (node == nullptr) return nullptr;
 
-                // push children nodes for the next level
-                if (curr->left) q.push(curr->left);
-                if (curr->right) q.push(curr->right);
-            }
+        // copy a shared node before handing out its value
+        if ( Unshare(node) ) ResetSpines();
+
+        if (key < KeyOf(node->data))
+        {
+            descent.Turn(false);
+            return Find(key, node->left, descent);
         }
+        
+        else if (key > KeyOf(node->data))
+        {
+            descent.Turn(true);
+            return Find(key, node->right, descent);
+        }
+        
+        descent.node = node;
+        return IsErased(node) ? nullptr : node;
     }
 
-private:
     /**
-     * @brief Finds the minimum node.
-     * @param node The root of the tree to find the minimum key in.
-     * @return The minimum node.
+     * @brief Finds a node in the tree.
+     * @param key The key of the node to find.
+     * @param node The root of the tree to find in.
+     * @param descent The path taken to the node.
+     * @return The node with the key value.
      * 
-     * Finds the node with the smallest key value.
+     * Finds the node with a certain key value in the tree.
      */
-    ConstNodePointer Min(ConstNodePointer node) const
+    ConstNodePointer Find(const KeyType& key, NodePointer node, Descent& descent) const
     {
         if (node == nullptr) return nullptr;
 
-        // the minimum is the furthest left child
-        while (node->left)
-            node = node->left;
+        if (key < KeyOf(node->data))
+        {
+            descent.Turn(false);
+            return Find(key, node->left, descent);
+        }
         
-        return node;
+        else if (key > KeyOf(node->data))
+        {
+            descent.Turn(true);
+            return Find(key, node->right, descent);
+        }
+        
+        descent.node = node;
+        return IsErased(node) ? nullptr : node;
     }
 
     /**
-     * @brief Finds the maximum node.
-     * @param node The root of the tree to find the maximum key in.
-     * @return The maximum node.
+     * @brief Finds the closest node at or before a key.
+     * @param key The key to search for.
+     * @param node The root of the tree to search in.
+     * @return The node with the largest key not greater than key.
      * 
-     * Finds the node with the largest key value.
+     * Descends towards the key, remembering the last right turn.
      */
-    ConstNodePointer Max(ConstNodePointer node) const
+    ConstNodePointer Predecessor(const KeyType& key, ConstNodePointer node) const
     {
-        if (node == nullptr) return nullptr;
+        ConstNodePointer lastRight = nullptr;
 
-        // the maximum is the furthest right child
-        while (node->right)
-            node = node->right;
-        
-        return node;
+        while (node != nullptr)
+        {
+            if (key < KeyOf(node->data))
+                node = node->left;
+
+            else if (key > KeyOf(node->data))
+            {
+                lastRight = node;
+                node = node->right;
+            }
+
+            else return node;
+        }
+
+        return lastRight;
     }
 
     /**
-     * @brief Finds a node in the tree.
-     * @param key The key of the node to find.
-     * @param node The root of the tree to find in.
-     * @return The node with the key value.
+     * @brief Finds the closest node at or after a key.
+     * @param key The key to search for.
+     * @param node The root of the tree to search in.
+     * @return The node with the smallest key not less than key.
      * 
-     * Finds the node with a certain key value in the tree.
+     * Descends towards the key, remembering the last left turn.
      */
-    NodePointer Find(const KeyType& key, NodePointer node)
+    ConstNodePointer Successor(const KeyType& key, ConstNodePointer node) const
     {
-        if (node == nullptr) return nullptr;
+        ConstNodePointer lastLeft = nullptr;
 
-        if (key < node->data.first)
-            return Find(key, node->left);
-        
-        else if (key > node->data.first)
-            return Find(key, node->right);
-        
-        else return node;
+        while (node != nullptr)
+        {
+            if (key > KeyOf(node->data))
+                node = node->right;
+
+            else if (key < KeyOf(node->data))
+            {
+                lastLeft = node;
+                node = node->left;
+            }
+
+            else return node;
+        }
+
+        return lastLeft;
     }
 
     /**
-     * @brief Finds a node in the tree.
-     * @param key The key of the node to find.
-     * @param node The root of the tree to find in.
-     * @return The node with the key value.
+     * @brief Descends towards a key.
+     * @param key The key to descend towards.
+     * @param before The nodes where the descent turned right.
+     * @param after The nodes where the descent turned left.
      * 
-     * Finds the node with a certain key value in the tree.
+     * The nodes before are at or before the key, and the nodes after
+     * are after it. An exact match ends the descent, and the path to
+     * the minimum of its right subtree is added to the nodes after.
      */
-    ConstNodePointer Find(const KeyType& key, NodePointer node) const
+    void Descend( const KeyType& key,
+                  std::vector<ConstNodePointer>& before,
+                  std::vector<ConstNodePointer>& after ) const
     {
-        if (node == nullptr) return nullptr;
+        for (ConstNodePointer node = m_Root; node != nullptr; )
+        {
+            if (key < KeyOf(node->data))
+            {
+                after.push_back(node);
+                node = node->left;
+            }
+            else
+            {
+                before.push_back(node);
 
-        if (key < node->data.first)
-            return Find(key, node->left);
-        
-        else if (key > node->data.first)
-            return Find(key, node->right);
-        
-        else return node;
+                if ( !(key > KeyOf(node->data)) )
+                {
+                    for (node = node->right; node != nullptr; node = node->left)
+                        after.push_back(node);
+                    break;
+                }
+
+                node = node->right;
+            }
+        }
     }
 
     /**
-     * @brief Copies a tree.
-     * @param node The current node to copy.
-     * @return The root of the new tree.
+     * @brief Steps backwards from a descent.
+     * @param before The nodes where the descent turned right.
+     * @return The next node that is not erased, or nullptr.
      * 
-     * Recursively copies the nodes of a tree.
+     * The next node before is the maximum of the left subtree.
      */
-    NodePointer Copy(ConstNodePointer node)
+    static ConstNodePointer NextBefore(std::vector<ConstNodePointer>& before)
     {
-        if (node == nullptr) return nullptr;
+        while ( !before.empty() )
+        {
+            ConstNodePointer node = before.back();
+            before.pop_back();
 
-        // copy the node and its children
-        NodePointer root = new BinaryNode(node->data);
-        root->left = Copy(node->left);
-        root->right = Copy(node->right);
+            for (ConstNodePointer child = node->left; child != nullptr; child = child->right)
+                before.push_back(child);
 
-        return root;
+            if (!IsErased(node)) return node;
+        }
+
+        return nullptr;
+    }
+
+    /**
+     * @brief Steps forwards from a descent.
+     * @param after The nodes where the descent turned left.
+     * @return The next node that is not erased, or nullptr.
+     * 
+     * The next node after is the minimum of the right subtree.
+     */
+    static ConstNodePointer NextAfter(std::vector<ConstNodePointer>& after)
+    {
+        while ( !after.empty() )
+        {
+            ConstNodePointer node = after.back();
+            after.pop_back();
+
+            for (ConstNodePointer child = node->right; child != nullptr; child = child->left)
+                after.push_back(child);
+
+            if (!IsErased(node)) return node;
+        }
+
+        return nullptr;
     }
 
+    // the data of a node, or nullptr if there is no node
+    static ConstPointer AsPointer(ConstNodePointer node) { return node ? &node->data : nullptr; }
+
     /**
      * @brief Deletes the tree.
      * @param node The root of the tree to delete.
      * 
-     * Recursively destructs each node of the tree.
+     * Releases the tree, and sets its root to nullptr.
      */
     void Clear(NodePointer& node)
     {
-        if (node == nullptr) return;
-
-        // delete a node's children before itself
-        if (node->left) Clear(node->left);
-        if (node->right) Clear(node->right);
-
-        delete node;
+        Release(node);
         node = nullptr;
     }
     
@@ -344,25 +2909,54 @@ private:
      * @brief Inserts a new node into the tree.
      * @param data The data of the new node.
      * @param node The node to search for a place to insert.
+     * @param descent The path taken to the new node.
      * @return The newly inserted node.
      * 
      * Recursively finds a place to insert, and copies the data into a new node.
      */
-    NodePointer Insert(ConstReference data, NodePointer& node)
+    NodePointer Insert(ConstReference data, NodePointer& node, Descent& descent)
     {
+        // copy a shared node before changing its children
+        if ( node != nullptr && Unshare(node) ) ResetSpines();
+
         if (node == nullptr)
         {
             ++m_Size;
-            node = new BinaryNode(data);
+            node = NewNode(data);
+            Index(node);
+            descent.node = node;
+            descent.changed = true;
         }
 
         // smaller key values go to the left child
-        else if (data.first < node->data.first)
-            node->left = Insert(data, node->left);
+        else if (KeyOf(data) < KeyOf(node->data))
+        {
+            descent.Turn(false);
+            node->left = Insert(data, node->left, descent);
+        }
         
         // larger key values go to the right child
-        else if (data.first > node->data.first)
-            node->right = Insert(data, node->right);
+        else if (KeyOf(data) > KeyOf(node->data))
+        {
+            descent.Turn(true);
+            node->right = Insert(data, node->right, descent);
+        }
+
+        // a node with the same key is kept as it is, unless it was
+        // lazily erased, in which case it is brought back
+        else
+        {
+            descent.node = node;
+
+            if (IsErased(node))
+            {
+                node->data = data;
+                SetErased(node, false);
+                descent.changed = true;
+                ++m_Size;
+                --m_Tombstones;
+            }
+        }
         
         return node;
     }
@@ -371,25 +2965,54 @@ private:
      * @brief Inserts a new node into the tree.
      * @param data The data of the new node.
      * @param node The node to search for a place to insert.
+     * @param descent The path taken to the new node.
      * @return The newly inserted node.
      * 
      * Recursively finds a place to insert, and moves the data into a new node.
      */
-    NodePointer Insert(Pair&& data, NodePointer& node)
+    NodePointer Insert(Pair&& data, NodePointer& node, Descent& descent)
     {
+        // copy a shared node before changing its children
+        if ( node != nullptr && Unshare(node) ) ResetSpines();
+
         if (node == nullptr)
         {
             ++m_Size;
-            node = new BinaryNode( std::move(data) );
+            node = NewNode( std::move(data) );
+            Index(node);
+            descent.node = node;
+            descent.changed = true;
         }
 
         // smaller key values go to the left child
-        else if (data.first < node->data.first)
-            node->left = Insert( std::move(data), node->left );
+        else if (KeyOf(data) < KeyOf(node->data))
+        {
+            descent.Turn(false);
+            node->left = Insert( std::move(data), node->left, descent );
+        }
         
         // larger key values go to the right child
-        else if (data.first > node->data.first)
-            node->right = Insert( std::move(data), node->right );
+        else if (KeyOf(data) > KeyOf(node->data))
+        {
+            descent.Turn(true);
+            node->right = Insert( std::move(data), node->right, descent );
+        }
+
+        // a node with the same key is kept as it is, unless it was
+        // lazily erased, in which case it is brought back
+        else
+        {
+            descent.node = node;
+
+            if (IsErased(node))
+            {
+                node->data = std::move(data);
+                SetErased(node, false);
+                descent.changed = true;
+                ++m_Size;
+                --m_Tombstones;
+            }
+        }
         
         return node;
     }
@@ -398,28 +3021,41 @@ private:
      * @brief Erases a node from the tree.
      * @param key The key of the node to delete.
      * @param node The root of the tree to delete in.
+     * @param descent The path taken to the node.
      * @return The node that replaced the deleted one.
      * 
      * Recursively finds a node, and deletes it.
      */
-    NodePointer Erase(const KeyType& key, NodePointer& node)
+    NodePointer Erase(const KeyType& key, NodePointer& node, Descent& descent)
     {
         if (node == nullptr) return nullptr;
 
+        // copy a shared node before changing it
+        if ( Unshare(node) ) ResetSpines();
+
         // smaller key values go to the left child
-        if (key < node->data.first)
-            node->left = Erase(key, node->left);
+        if (key < KeyOf(node->data))
+        {
+            descent.Turn(false);
+            node->left = Erase(key, node->left, descent);
+        }
         
         // larger key values go to the right child
-        else if (key > node->data.first)
-            node->right = Erase(key, node->right);
+        else if (key > KeyOf(node->data))
+        {
+            descent.Turn(true);
+            node->right = Erase(key, node->right, descent);
+        }
         
         // the node to delete has two children
         // replace this node with the smallest in the right subtree
         else if (node->left && node->right)
         {
+            Unindex(node);
             node->data = Min(node->right)->data;
-            Erase(node->data.first, node->right);
+            descent.Turn(true);
+            Erase(KeyOf(node->data), node->right, descent);
+            Index(node);
         }
 
         // the node to delete has one or zero children
@@ -432,7 +3068,10 @@ private:
             if (node->left) node = node->left;
             else node = node->right;
 
-            delete old;
+            SpliceSpines(old, node, descent.depth);
+            Unindex(old);
+            DeleteNode(old);
+            descent.changed = true;
             --m_Size;
         }
 
@@ -0,0 +1,28 @@
+// These are static tracepoints for the binary search tree, in the
+// style of <sys/sdt.h>. They are compiled in when BST_ENABLE_USDT is
+// defined and the header is available, and can then be attached to
+// in a live process with bpftrace or perf, for example:
+//
+//     bpftrace -e 'usdt:./app:bst:find__return { @depth = hist(arg1); }'
+//
+// Otherwise every probe expands to nothing, and its arguments are
+// never evaluated.
+
+#pragma once
+
+#if defined(BST_ENABLE_USDT) && defined(__has_include)
+#if __has_include(<sys/sdt.h>)
+#include <sys/sdt.h>
+#define BST_USDT_AVAILABLE 1
+#endif
+#endif
+
+#ifdef BST_USDT_AVAILABLE
+#define BST_PROBE1(name, a)       DTRACE_PROBE1(bst, name, a)
+#define BST_PROBE2(name, a, b)    DTRACE_PROBE2(bst, name, a, b)
+#define BST_PROBE3(name, a, b, c) DTRACE_PROBE3(bst, name, a, b, c)
+#else
+#define BST_PROBE1(name, a)       ((void)0)
+#define BST_PROBE2(name, a, b)    ((void)0)
+#define BST_PROBE3(name, a, b, c) ((void)0)
+#endif
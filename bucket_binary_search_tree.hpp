@@ -0,0 +1,514 @@
+// This is a binary search tree whose leaves are buckets of sorted
+// entries. Inner nodes only route a search left or right of their
+// separator key, and each leaf holds up to BucketCapacity entries, so
+// there are far fewer pointers per entry than with a node per entry.
+// A full bucket is split in two under a new inner node. A bucket that
+// shrinks is merged with the next bucket in key order once their
+// entries fit into one, or else borrows entries from it when it runs
+// low, so erases cannot leave a trail of nearly empty buckets.
+//
+// Keys and values are kept in separate arrays in each bucket, so a
+// search scans the keys without branching, which the compiler can
+// vectorize. Keys and values must be default constructible.
+
+#pragma once
+
+#include <cstddef>
+#include <utility>
+
+template<typename KeyType, typename ValueType, std::size_t BucketCapacity = 16>
+class BucketBinarySearchTree
+{
+    static_assert(BucketCapacity > 1, "a bucket must hold at least two entries");
+
+public:
+    using SizeType       = std::size_t;
+    using Pair           = std::pair<KeyType, ValueType>;
+    using ConstReference = const Pair&;
+
+    // an entry is stored apart, so it is referred to by its parts
+    using EntryReference = std::pair<const KeyType&, const ValueType&>;
+
+    // buckets are merged once they fit in half of a bucket together,
+    // so a size near the capacity does not keep splitting and merging
+    static constexpr SizeType MERGE_THRESHOLD = BucketCapacity / 2;
+
+    // buckets with fewer entries than this borrow from their neighbour
+    static constexpr SizeType BORROW_THRESHOLD = BucketCapacity / 4;
+
+private:
+    struct BucketNode
+    {
+        bool leaf;
+    };
+
+    struct InnerNode : BucketNode
+    {
+        // smaller keys are to the left, and the rest to the right
+        KeyType separator;
+        BucketNode* left;
+        BucketNode* right;
+
+        InnerNode(const KeyType& newSeparator, BucketNode* newLeft, BucketNode* newRight)
+            : BucketNode{false},
+              separator(newSeparator),
+              left(newLeft),
+              right(newRight)
+        { }
+    };
+
+    struct LeafNode : BucketNode
+    {
+        SizeType count;
+        KeyType keys[BucketCapacity];
+        ValueType values[BucketCapacity];
+
+        LeafNode()
+            : BucketNode{true},
+              count(0),
+              keys(),
+              values()
+        { }
+    };
+
+    BucketNode* m_Root;
+    SizeType m_Size;
+
+public:
+    /**
+     * @brief Default constructor.
+     * 
+     * Creates a tree with nullptr as the root.
+     */
+    BucketBinarySearchTree()
+        : m_Root(nullptr),
+          m_Size(0)
+    { }
+
+    /**
+     * @brief Copy constructor.
+     * @param other The tree to copy.
+     * 
+     * Creates a new tree by copying the nodes of the other.
+     */
+    BucketBinarySearchTree(const BucketBinarySearchTree& other)
+        : m_Root( Copy(other.m_Root) ),
+          m_Size(other.m_Size)
+    { }
+
+    /**
+     * @brief Move constructor.
+     * @param other The tree to move.
+     * 
+     * Creates a new tree by moving the contents of the other.
+     */
+    BucketBinarySearchTree(BucketBinarySearchTree&& other)
+        : m_Root(other.m_Root),
+          m_Size(other.m_Size)
+    {
+        other.m_Root = nullptr;
+        other.m_Size = 0;
+    }
+
+    ~BucketBinarySearchTree() { Clear(m_Root); }
+
+    BucketBinarySearchTree& operator=(const BucketBinarySearchTree& other)
+    {
+        if (this == &other) return *this;
+
+        Clear();
+        m_Root = Copy(other.m_Root);
+        m_Size = other.m_Size;
+
+        return *this;
+    }
+
+    BucketBinarySearchTree& operator=(BucketBinarySearchTree&& other)
+    {
+        if (this == &other) return *this;
+
+        Clear();
+        m_Root = other.m_Root;
+        m_Size = other.m_Size;
+        other.m_Root = nullptr;
+        other.m_Size = 0;
+
+        return *this;
+    }
+
+    SizeType Size() const { return m_Size; }
+    bool Empty() const { return m_Size == 0; }
+
+    // get the number of levels, counting the buckets as one
+    SizeType Height() const { return Height(m_Root); }
+
+    // get the entries with the smallest and largest keys
+    EntryReference Min() const
+    {
+        const LeafNode* leaf = Leftmost(m_Root);
+        return EntryReference(leaf->keys[0], leaf->values[0]);
+    }
+
+    EntryReference Max() const
+    {
+        const LeafNode* leaf = Rightmost(m_Root);
+        return EntryReference(leaf->keys[leaf->count - 1], leaf->values[leaf->count - 1]);
+    }
+
+    // find entries in the tree
+    bool Contains(const KeyType& key) const
+    {
+        if (m_Root == nullptr) return false;
+
+        const LeafNode* leaf = FindLeaf(key);
+        SizeType i = Position(leaf, key);
+        return i < leaf->count && !(key < leaf->keys[i]);
+    }
+
+    ValueType& Find(const KeyType& key)
+    {
+        LeafNode* leaf = FindLeaf(key);
+        return leaf->values[ Position(leaf, key) ];
+    }
+
+    const ValueType& Find(const KeyType& key) const
+    {
+        const LeafNode* leaf = FindLeaf(key);
+        return leaf->values[ Position(leaf, key) ];
+    }
+
+    // delete all the nodes in the tree
+    void Clear()
+    {
+        Clear(m_Root);
+        m_Root = nullptr;
+        m_Size = 0;
+    }
+
+    // insert entries into the tree
+    void Insert(ConstReference data) { Emplace(data); }
+    void Insert(Pair&& data) { Emplace( std::move(data) ); }
+
+    /**
+     * @brief Removes an entry from the tree.
+     * @param key The key of the entry to remove.
+     * 
+     * Shifts the larger entries of its bucket down. An emptied bucket
+     * is removed along with its parent. A bucket that fits into the
+     * bucket next to it in key order is merged into it, and one that
+     * runs low borrows entries from it instead.
+     */
+    void Erase(const KeyType& key)
+    {
+        if (m_Root == nullptr) return;
+
+        // the links to the lowest ancestors that the bucket is left and
+        // right of, where its path splits from the adjacent buckets
+        BucketNode** nextFork = nullptr;
+        BucketNode** previousFork = nullptr;
+
+        BucketNode** parentLink = nullptr;
+        BucketNode** link = &m_Root;
+        while ( !(*link)->leaf )
+        {
+            InnerNode* inner = static_cast<InnerNode*>(*link);
+            parentLink = link;
+
+            if (key < inner->separator)
+            {
+                nextFork = link;
+                link = &inner->left;
+            }
+            else
+            {
+                previousFork = link;
+                link = &inner->right;
+            }
+        }
+
+        LeafNode* leaf = static_cast<LeafNode*>(*link);
+        SizeType i = Position(leaf, key);
+        if ( i == leaf->count || key < leaf->keys[i] ) return;
+
+        for (SizeType j = i + 1; j < leaf->count; ++j)
+        {
+            leaf->keys[j - 1] = std::move(leaf->keys[j]);
+            leaf->values[j - 1] = std::move(leaf->values[j]);
+        }
+
+        --leaf->count;
+        --m_Size;
+
+        if (parentLink == nullptr)
+        {
+            if (leaf->count == 0) Clear();
+            return;
+        }
+
+        if (leaf->count == 0)
+        {
+            Unlink(parentLink, leaf);
+            return;
+        }
+
+        // a bucket with this many entries cannot merge, and need not borrow
+        if ( !(leaf->count < MERGE_THRESHOLD) ) return;
+
+        // the adjacent bucket is the outermost one of the fork's other
+        // subtree, preferring the next one
+        bool next = nextFork != nullptr;
+        BucketNode** forkLink = next ? nextFork : previousFork;
+        InnerNode* fork = static_cast<InnerNode*>(*forkLink);
+
+        BucketNode** neighborParentLink = forkLink;
+        BucketNode** neighborLink = next ? &fork->right : &fork->left;
+        while ( !(*neighborLink)->leaf )
+        {
+            InnerNode* inner = static_cast<InnerNode*>(*neighborLink);
+            neighborParentLink = neighborLink;
+            neighborLink = next ? &inner->left : &inner->right;
+        }
+
+        LeafNode* neighbor = static_cast<LeafNode*>(*neighborLink);
+        LeafNode* left = next ? leaf : neighbor;
+        LeafNode* right = next ? neighbor : leaf;
+        SizeType total = left->count + right->count;
+
+        // the smaller bucket is merged into the larger one, and the fork
+        // now splits the keys before the merged bucket from it
+        if ( !(total > MERGE_THRESHOLD) )
+        {
+            fork->separator = left->keys[0];
+            Redistribute(left, right, 0);
+            Unlink(next ? parentLink : neighborParentLink, left);
+        }
+        else if (leaf->count < BORROW_THRESHOLD)
+        {
+            Redistribute(left, right, total / 2);
+            fork->separator = right->keys[0];
+        }
+    }
+
+private:
+    /**
+     * @brief Inserts an entry into the tree.
+     * @param data The data of the new entry.
+     * 
+     * Finds the bucket for the key, and shifts its larger entries up
+     * to make room. A full bucket is split into two halves first. An
+     * entry with the same key is kept as it is.
+     */
+    template<typename NewPair>
+    void Emplace(NewPair&& data)
+    {
+        if (m_Root == nullptr) m_Root = new LeafNode();
+
+        BucketNode** link = &m_Root;
+        while ( !(*link)->leaf )
+        {
+            InnerNode* inner = static_cast<InnerNode*>(*link);
+            link = data.first < inner->separator ? &inner->left : &inner->right;
+        }
+
+        LeafNode* leaf = static_cast<LeafNode*>(*link);
+        SizeType i = Position(leaf, data.first);
+        if ( i < leaf->count && !(data.first < leaf->keys[i]) ) return;
+
+        if (leaf->count == BucketCapacity)
+        {
+            LeafNode* right = Split(leaf);
+            *link = new InnerNode(right->keys[0], leaf, right);
+
+            if (i > leaf->count)
+            {
+                i -= leaf->count;
+                leaf = right;
+            }
+        }
+
+        for (SizeType j = leaf->count; j > i; --j)
+        {
+            leaf->keys[j] = std::move(leaf->keys[j - 1]);
+            leaf->values[j] = std::move(leaf->values[j - 1]);
+        }
+
+        leaf->keys[i] = std::forward<NewPair>(data).first;
+        leaf->values[i] = std::forward<NewPair>(data).second;
+        ++leaf->count;
+        ++m_Size;
+    }
+
+    // remove a bucket and its parent, whose other child takes its place
+    static void Unlink(BucketNode** parentLink, LeafNode* leaf)
+    {
+        InnerNode* parent = static_cast<InnerNode*>(*parentLink);
+        *parentLink = parent->left == leaf ? parent->right : parent->left;
+
+        delete leaf;
+        delete parent;
+    }
+
+    /**
+     * @brief Moves entries between two adjacent buckets.
+     * @param left The bucket with the smaller keys.
+     * @param right The bucket with the larger keys.
+     * @param count The number of entries to leave in the left bucket.
+     */
+    static void Redistribute(LeafNode* left, LeafNode* right, SizeType count)
+    {
+        SizeType total = left->count + right->count;
+
+        if (count > left->count)
+        {
+            // take the smallest entries of the right bucket
+            SizeType moved = count - left->count;
+            for (SizeType i = 0; i < moved; ++i)
+            {
+                left->keys[left->count + i] = std::move(right->keys[i]);
+                left->values[left->count + i] = std::move(right->values[i]);
+            }
+
+            for (SizeType i = moved; i < right->count; ++i)
+            {
+                right->keys[i - moved] = std::move(right->keys[i]);
+                right->values[i - moved] = std::move(right->values[i]);
+            }
+        }
+        else
+        {
+            // give the largest entries of the left bucket
+            SizeType moved = left->count - count;
+            for (SizeType i = right->count; i > 0; --i)
+            {
+                right->keys[i - 1 + moved] = std::move(right->keys[i - 1]);
+                right->values[i - 1 + moved] = std::move(right->values[i - 1]);
+            }
+
+            for (SizeType i = 0; i < moved; ++i)
+            {
+                right->keys[i] = std::move(left->keys[count + i]);
+                right->values[i] = std::move(left->values[count + i]);
+            }
+        }
+
+        left->count = count;
+        right->count = total - count;
+    }
+
+    /**
+     * @brief Finds the place of a key in a bucket.
+     * @param leaf The bucket to search.
+     * @param key The key to search for.
+     * @return The number of keys in the bucket less than key.
+     * 
+     * Counts the smaller keys over the whole bucket, rather than
+     * stopping at the first larger key, so the loop has no branches.
+     */
+    static SizeType Position(const LeafNode* leaf, const KeyType& key)
+    {
+        SizeType position = 0;
+        for (SizeType i = 0; i < leaf->count; ++i)
+            position += leaf->keys[i] < key;
+        return position;
+    }
+
+    // find the bucket a key belongs in
+    LeafNode* FindLeaf(const KeyType& key) const
+    {
+        BucketNode* node = m_Root;
+
+        while (!node->leaf)
+        {
+            const InnerNode* inner = static_cast<const InnerNode*>(node);
+            node = key < inner->separator ? inner->left : inner->right;
+        }
+
+        return static_cast<LeafNode*>(node);
+    }
+
+    static const LeafNode* Leftmost(const BucketNode* node)
+    {
+        while (!node->leaf) node = static_cast<const InnerNode*>(node)->left;
+        return static_cast<const LeafNode*>(node);
+    }
+
+    static const LeafNode* Rightmost(const BucketNode* node)
+    {
+        while (!node->leaf) node = static_cast<const InnerNode*>(node)->right;
+        return static_cast<const LeafNode*>(node);
+    }
+
+    /**
+     * @brief Splits a full bucket.
+     * @param leaf The bucket to split, which keeps the smaller half.
+     * @return A new bucket with the larger half.
+     */
+    static LeafNode* Split(LeafNode* leaf)
+    {
+        LeafNode* right = new LeafNode();
+        SizeType half = leaf->count / 2;
+
+        for (SizeType i = half; i < leaf->count; ++i)
+        {
+            right->keys[i - half] = std::move(leaf->keys[i]);
+            right->values[i - half] = std::move(leaf->values[i]);
+        }
+
+        right->count = leaf->count - half;
+        leaf->count = half;
+
+        return right;
+    }
+
+    /**
+     * @brief Copies a tree.
+     * @param node The current node to copy.
+     * @return The root of the new tree.
+     * 
+     * Recursively copies the nodes of a tree.
+     */
+    static BucketNode* Copy(const BucketNode* node)
+    {
+        if (node == nullptr) return nullptr;
+        if (node->leaf) return new LeafNode( *static_cast<const LeafNode*>(node) );
+
+        const InnerNode* inner = static_cast<const InnerNode*>(node);
+        return new InnerNode( inner->separator, Copy(inner->left), Copy(inner->right) );
+    }
+
+    /**
+     * @brief Finds the height of a tree.
+     * @param node The root of the tree.
+     * @return The number of levels of the tree.
+     * 
+     * Recursively finds the taller of the two subtrees.
+     */
+    static SizeType Height(const BucketNode* node)
+    {
+        if (node == nullptr) return 0;
+        if (node->leaf) return 1;
+
+        const InnerNode* inner = static_cast<const InnerNode*>(node);
+        SizeType left = Height(inner->left);
+        SizeType right = Height(inner->right);
+
+        return 1 + (left > right ? left : right);
+    }
+
+    // delete the nodes of a tree, children first
+    static void Clear(BucketNode* node)
+    {
+        if (node == nullptr) return;
+
+        if (node->leaf)
+        {
+            delete static_cast<LeafNode*>(node);
+            return;
+        }
+
+        InnerNode* inner = static_cast<InnerNode*>(node);
+        Clear(inner->left);
+        Clear(inner->right);
+        delete inner;
+    }
+};
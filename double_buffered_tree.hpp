@@ -0,0 +1,267 @@
+// This wraps a binary search tree that is replaced wholesale, so that
+// readers never wait for writers. Writers build the next tree off to
+// the side and publish it with a single atomic swap. Readers pin the
+// tree they are using with a hazard pointer, and a replaced tree is
+// only destroyed by a writer, once no reader has it pinned.
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "binary_search_tree.hpp"
+
+template<typename KeyType, typename ValueType, typename KeyOfValue = void>
+class DoubleBufferedTree
+{
+public:
+    using SizeType = std::size_t;
+    // every write copies the tree, so its nodes are shared
+    using Tree     = BinarySearchTree<KeyType, ValueType, KeyOfValue, BST_SHARED_NODES>;
+
+    // the hazard pointers in each block, where another block is added
+    // whenever every slot is claimed
+    static constexpr SizeType READER_SLOTS = 128;
+
+private:
+    // a hazard pointer, kept on a cache line of its own
+    struct alignas(64) ReaderSlot
+    {
+        std::atomic<bool> claimed{false};
+        std::atomic<const Tree*> hazard{nullptr};
+    };
+
+    // blocks are only appended, and live as long as the tree
+    struct SlotBlock
+    {
+        ReaderSlot slots[READER_SLOTS];
+        std::atomic<SlotBlock*> next{nullptr};
+    };
+
+    std::atomic<Tree*> m_Current;
+    mutable SlotBlock m_Slots;
+
+    // writers are serialized, and own the retired trees
+    std::mutex m_WriteMutex;
+    std::vector<Tree*> m_Retired;
+
+public:
+    // This pins the current tree for as long as it lives. The tree
+    // it reads is not destroyed, even when a newer one is published.
+    class ReadGuard
+    {
+        ReaderSlot* m_Slot;
+        const Tree* m_Tree;
+
+    public:
+        explicit ReadGuard(const DoubleBufferedTree& owner)
+            : m_Slot( owner.ClaimSlot() ),
+              m_Tree(nullptr)
+        {
+            // the tree is only safe once it is still current after being
+            // pinned, since a writer may have retired it in between
+            const Tree* tree = owner.m_Current.load(std::memory_order_acquire);
+            while (1)
+            {
+                m_Slot->hazard.store(tree, std::memory_order_seq_cst);
+
+                const Tree* current = owner.m_Current.load(std::memory_order_seq_cst);
+                if (current == tree) break;
+                tree = current;
+            }
+
+            m_Tree = tree;
+        }
+
+        ReadGuard(ReadGuard&& other)
+            : m_Slot(other.m_Slot),
+              m_Tree(other.m_Tree)
+        {
+            other.m_Slot = nullptr;
+            other.m_Tree = nullptr;
+        }
+
+        ReadGuard(const ReadGuard&) = delete;
+        ReadGuard& operator=(const ReadGuard&) = delete;
+        ReadGuard& operator=(ReadGuard&&) = delete;
+
+        ~ReadGuard()
+        {
+            if (m_Slot == nullptr) return;
+
+            m_Slot->hazard.store(nullptr, std::memory_order_release);
+            m_Slot->claimed.store(false, std::memory_order_release);
+        }
+
+        const Tree& operator*() const { return *m_Tree; }
+        const Tree* operator->() const { return m_Tree; }
+    };
+
+    /**
+     * @brief Default constructor.
+     * @param tree The first tree to publish.
+     * 
+     * Publishes the tree to readers.
+     */
+    explicit DoubleBufferedTree(Tree tree = Tree())
+        : m_Current( new Tree( std::move(tree) ) )
+    { }
+
+    DoubleBufferedTree(const DoubleBufferedTree&) = delete;
+    DoubleBufferedTree& operator=(const DoubleBufferedTree&) = delete;
+
+    // destroy every tree, which no reader may still be holding
+    ~DoubleBufferedTree()
+    {
+        delete m_Current.load(std::memory_order_acquire);
+
+        for (Tree* tree : m_Retired)
+            delete tree;
+
+        SlotBlock* block = m_Slots.next.load(std::memory_order_acquire);
+        while (block != nullptr)
+        {
+            SlotBlock* next = block->next.load(std::memory_order_relaxed);
+            delete block;
+            block = next;
+        }
+    }
+
+    // pin the current tree for reading
+    ReadGuard Read() const { return ReadGuard(*this); }
+
+    /**
+     * @brief Publishes a new tree.
+     * @param next The tree to replace the current one.
+     * 
+     * Swaps the new tree in for readers, and retires the old one. The
+     * retired trees that no reader still holds are destroyed here, in
+     * the writer, so readers never pay for clearing a tree.
+     */
+    void Publish(Tree next)
+    {
+        Tree* tree = new Tree( std::move(next) );
+
+        std::lock_guard<std::mutex> lock(m_WriteMutex);
+        m_Retired.push_back( m_Current.exchange(tree, std::memory_order_seq_cst) );
+        Reclaim(lock);
+    }
+
+    /**
+     * @brief Changes a copy of the current tree, and publishes it.
+     * @param change Called with the copy, to change it.
+     * 
+     * The copy shares its nodes with the current tree until they are
+     * changed, so only the changed paths are copied. Concurrent
+     * updates are applied one at a time.
+     */
+    template<typename Function>
+    void Update(Function change)
+    {
+        std::lock_guard<std::mutex> lock(m_WriteMutex);
+
+        Tree* tree = new Tree( *m_Current.load(std::memory_order_acquire) );
+        change(*tree);
+
+        m_Retired.push_back( m_Current.exchange(tree, std::memory_order_seq_cst) );
+        Reclaim(lock);
+    }
+
+    /**
+     * @brief Destroys the retired trees that are no longer read.
+     * @return The number of retired trees still held by readers.
+     */
+    SizeType Reclaim()
+    {
+        std::lock_guard<std::mutex> lock(m_WriteMutex);
+        return Reclaim(lock);
+    }
+
+private:
+    /**
+     * @brief Destroys the retired trees that are no longer read.
+     * @param lock The held lock of the writers.
+     * @return The number of retired trees still held by readers.
+     * 
+     * Checks every retired tree against the hazard pointers.
+     */
+    SizeType Reclaim(const std::lock_guard<std::mutex>&)
+    {
+        SizeType kept = 0;
+
+        for (Tree* tree : m_Retired)
+        {
+            if ( IsPinned(tree) ) m_Retired[kept++] = tree;
+            else delete tree;
+        }
+
+        m_Retired.resize(kept);
+        return kept;
+    }
+
+    // get whether any reader holds a tree
+    bool IsPinned(const Tree* tree) const
+    {
+        for (const SlotBlock* block = &m_Slots; block != nullptr; block = block->next.load(std::memory_order_acquire))
+        {
+            for (const ReaderSlot& slot : block->slots)
+            {
+                if (slot.hazard.load(std::memory_order_seq_cst) == tree) return true;
+            }
+        }
+
+        return false;
+    }
+
+    /**
+     * @brief Claims a hazard pointer for a reader.
+     * @return The claimed slot.
+     * 
+     * Starts from the slot the thread used last, so a thread usually
+     * finds its own slot free. When every slot of every block is
+     * claimed, the reader appends a block of its own instead of waiting
+     * for a slot to be released.
+     */
+    ReaderSlot* ClaimSlot() const
+    {
+        thread_local SizeType hint = std::hash<std::thread::id>()( std::this_thread::get_id() ) % READER_SLOTS;
+
+        SlotBlock* block = &m_Slots;
+        while (1)
+        {
+            for (SizeType i = 0; i < READER_SLOTS; ++i)
+            {
+                SizeType index = (hint + i) % READER_SLOTS;
+                ReaderSlot& slot = block->slots[index];
+
+                if ( !slot.claimed.load(std::memory_order_relaxed) &&
+                     !slot.claimed.exchange(true, std::memory_order_acquire) )
+                {
+                    hint = index;
+                    return &slot;
+                }
+            }
+
+            SlotBlock* next = block->next.load(std::memory_order_acquire);
+            if (next == nullptr)
+            {
+                // the new block is claimed before it is linked, and another
+                // reader may have linked one first, which is used instead
+                SlotBlock* added = new SlotBlock;
+                added->slots[hint].claimed.store(true, std::memory_order_relaxed);
+
+                if ( block->next.compare_exchange_strong(next, added, std::memory_order_acq_rel) )
+                    return &added->slots[hint];
+
+                delete added;
+            }
+
+            block = next;
+        }
+    }
+};
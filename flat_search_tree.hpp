@@ -0,0 +1,211 @@
+// This is a search tree flattened into a sorted, contiguous array of
+// pairs. Lookups are binary searches, narrowed first by interpolation
+// when keys are arithmetic, and touch far fewer cache lines than a
+// pointer tree. Inserting and erasing shift the array, so it suits
+// trees that are read much more often than they are changed. Popping
+// the minimum or maximum shifts nothing, so a tree can be drained from
+// either end in linear time.
+
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+template<typename KeyType, typename ValueType>
+class FlatSearchTree
+{
+public:
+    using SizeType       = std::size_t;
+    using Pair           = std::pair<KeyType, ValueType>;
+    using Pointer        = Pair*;
+    using ConstPointer   = const Pair*;
+    using Reference      = Pair&;
+    using ConstReference = const Pair&;
+
+    // ranges at least this long are narrowed by interpolation
+    static constexpr SizeType INTERPOLATION_RANGE = 64;
+
+private:
+    // the pairs before the first one have been popped, and are only
+    // dropped once they outnumber the rest
+    std::vector<Pair> m_Pairs;
+    SizeType m_First = 0;
+
+public:
+    FlatSearchTree() = default;
+
+    /**
+     * @brief Initialize constructor.
+     * @param pairs The pairs of the tree, sorted by unique keys.
+     * 
+     * Takes over the pairs without sorting them again.
+     */
+    explicit FlatSearchTree(std::vector<Pair>&& pairs)
+        : m_Pairs( std::move(pairs) )
+    { }
+
+    SizeType Size() const { return m_Pairs.size() - m_First; }
+    bool Empty() const { return Size() == 0; }
+
+    // move the pairs out in key order, leaving the tree empty
+    std::vector<Pair> TakePairs()
+    {
+        m_Pairs.erase( m_Pairs.begin(), m_Pairs.begin() + m_First );
+        m_First = 0;
+        return std::move(m_Pairs);
+    }
+
+    ConstReference Min() const { return m_Pairs[m_First]; }
+    ConstReference Max() const { return m_Pairs.back(); }
+
+    /**
+     * @brief Removes the minimum and maximum pairs.
+     * @return The removed pair.
+     * 
+     * The minimum is only passed over, and the popped pairs are
+     * dropped together once they outnumber the rest, so each pop
+     * takes O(1) amortized.
+     */
+    Pair PopMin()
+    {
+        Pair data = std::move(m_Pairs[m_First]);
+        ++m_First;
+        DropPopped();
+        return data;
+    }
+
+    Pair PopMax()
+    {
+        Pair data = std::move( m_Pairs.back() );
+        m_Pairs.pop_back();
+        DropPopped();
+        return data;
+    }
+
+    // find pairs in the tree
+    bool Contains(const KeyType& key) const
+    {
+        SizeType i = LowerBound(key);
+        return i < m_Pairs.size() && !(key < m_Pairs[i].first);
+    }
+
+    ValueType& Find(const KeyType& key) { return m_Pairs[ LowerBound(key) ].second; }
+    const ValueType& Find(const KeyType& key) const { return m_Pairs[ LowerBound(key) ].second; }
+
+    // find the closest pairs at or before, and at or after, a key
+    ConstPointer Predecessor(const KeyType& key) const
+    {
+        SizeType i = LowerBound(key);
+        if ( i < m_Pairs.size() && !(key < m_Pairs[i].first) ) return &m_Pairs[i];
+        return i > m_First ? &m_Pairs[i - 1] : nullptr;
+    }
+
+    ConstPointer Successor(const KeyType& key) const
+    {
+        SizeType i = LowerBound(key);
+        return i < m_Pairs.size() ? &m_Pairs[i] : nullptr;
+    }
+
+    // delete all the pairs, and give back their memory
+    void Clear()
+    {
+        m_Pairs.clear();
+        m_Pairs.shrink_to_fit();
+        m_First = 0;
+    }
+
+    /**
+     * @brief Inserts a pair into the tree.
+     * @param data The pair to insert.
+     * 
+     * Shifts the larger pairs up to make room. A pair with the same
+     * key is kept as it is. A new minimum takes the place of the last
+     * popped pair, when there is one.
+     */
+    void Insert(ConstReference data) { Emplace(data); }
+    void Insert(Pair&& data) { Emplace( std::move(data) ); }
+
+    // remove a pair from the tree, shifting the larger pairs down
+    void Erase(const KeyType& key)
+    {
+        SizeType i = LowerBound(key);
+        if ( i < m_Pairs.size() && !(key < m_Pairs[i].first) )
+            m_Pairs.erase(m_Pairs.begin() + i);
+    }
+
+private:
+    template<typename NewPair>
+    void Emplace(NewPair&& data)
+    {
+        SizeType i = LowerBound(data.first);
+        if ( i < m_Pairs.size() && !(data.first < m_Pairs[i].first) ) return;
+
+        if (i == m_First && m_First > 0)
+        {
+            --m_First;
+            m_Pairs[m_First] = std::forward<NewPair>(data);
+            return;
+        }
+
+        m_Pairs.insert( m_Pairs.begin() + i, std::forward<NewPair>(data) );
+    }
+
+    // drop the popped pairs once they outnumber the rest
+    void DropPopped()
+    {
+        if ( m_First > Size() )
+        {
+            m_Pairs.erase( m_Pairs.begin(), m_Pairs.begin() + m_First );
+            m_First = 0;
+        }
+    }
+
+    /**
+     * @brief Finds the place of a key.
+     * @param key The key to search for.
+     * @return The index of the first pair whose key is not less than key.
+     */
+    SizeType LowerBound(const KeyType& key) const
+    {
+        SizeType first = m_First;
+        SizeType last = m_Pairs.size();
+        Narrow( key, first, last, std::is_arithmetic<KeyType>() );
+
+        return std::lower_bound( m_Pairs.begin() + first, m_Pairs.begin() + last, key,
+                                 [](const Pair& pair, const KeyType& k) { return pair.first < k; } ) - m_Pairs.begin();
+    }
+
+    /**
+     * @brief Narrows a search by interpolation.
+     * @param key The key to search for.
+     * @param first The first index the key's place can be at.
+     * @param last The last index the key's place can be at.
+     * 
+     * Guesses the place of the key from the keys at either end of the
+     * range, as if keys were spread evenly, for a few steps. Each step
+     * cuts the range at the guess, so an uneven spread only costs the
+     * steps that were taken.
+     */
+    void Narrow(const KeyType& key, SizeType& first, SizeType& last, std::true_type) const
+    {
+        for (int step = 0; step < 4 && !(last - first < INTERPOLATION_RANGE); ++step)
+        {
+            double low = static_cast<double>(m_Pairs[first].first);
+            double high = static_cast<double>(m_Pairs[last - 1].first);
+            double target = static_cast<double>(key);
+
+            if ( !(target > low) || !(target < high) ) return;
+
+            SizeType guess = first + static_cast<SizeType>( (target - low) / (high - low) * (last - 1 - first) );
+
+            if (m_Pairs[guess].first < key) first = guess + 1;
+            else last = guess;
+        }
+    }
+
+    // keys that are not arithmetic are only binary searched
+    void Narrow(const KeyType&, SizeType&, SizeType&, std::false_type) const { }
+};
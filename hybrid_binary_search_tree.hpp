@@ -0,0 +1,287 @@
+// This is a binary search tree that keeps small trees inline, as a
+// sorted array scanned from the front, which is faster than chasing
+// pointers for a handful of entries and never allocates. Once the
+// array overflows, the entries move into a BinarySearchTree. They
+// move back when the tree has shrunk to half of the array, so a size
+// that goes back and forth over the limit does not keep switching.
+
+#pragma once
+
+#include <cstddef>
+#include <new>
+#include <utility>
+#include <vector>
+
+#include "binary_search_tree.hpp"
+
+template<typename KeyType, typename ValueType, std::size_t InlineCapacity = 16>
+class HybridBinarySearchTree
+{
+    static_assert(InlineCapacity > 1, "the inline array must hold at least two entries");
+
+public:
+    using Tree           = BinarySearchTree<KeyType, ValueType>;
+    using SizeType       = std::size_t;
+    using Pair           = typename Tree::Pair;
+    using Pointer        = Pair*;
+    using ConstPointer   = const Pair*;
+    using Reference      = Pair&;
+    using ConstReference = const Pair&;
+
+    // a tree that shrinks to this size moves back inline
+    static constexpr SizeType INLINE_THRESHOLD = InlineCapacity / 2;
+
+private:
+    // the inline entries, in key order, which are only constructed
+    // while the tree is inline
+    alignas(Pair) unsigned char m_Inline[ InlineCapacity * sizeof(Pair) ];
+    SizeType m_InlineSize;
+    bool m_IsInline;
+
+    Tree m_Tree;
+
+public:
+    /**
+     * @brief Default constructor.
+     * 
+     * Creates an empty tree, inline.
+     */
+    HybridBinarySearchTree()
+        : m_InlineSize(0),
+          m_IsInline(true)
+    { }
+
+    /**
+     * @brief Copy constructor.
+     * @param other The tree to copy.
+     * 
+     * Copies inline entries, and shares the nodes of a node tree.
+     */
+    HybridBinarySearchTree(const HybridBinarySearchTree& other)
+        : m_InlineSize(0),
+          m_IsInline(other.m_IsInline),
+          m_Tree(other.m_Tree)
+    {
+        for (SizeType i = 0; i < other.m_InlineSize; ++i)
+            new ( &Entry(i) ) Pair( other.Entry(i) );
+        m_InlineSize = other.m_InlineSize;
+    }
+
+    ~HybridBinarySearchTree() { ClearInline(); }
+
+    /**
+     * @brief Copy assignment operator.
+     * @param other The tree to copy.
+     * 
+     * Recreates the tree as a copy of the other.
+     */
+    HybridBinarySearchTree& operator=(const HybridBinarySearchTree& other)
+    {
+        if (this == &other) return *this;
+
+        ClearInline();
+        for (SizeType i = 0; i < other.m_InlineSize; ++i)
+            new ( &Entry(i) ) Pair( other.Entry(i) );
+        m_InlineSize = other.m_InlineSize;
+        m_IsInline = other.m_IsInline;
+        m_Tree = other.m_Tree;
+
+        return *this;
+    }
+
+    SizeType Size() const { return m_IsInline ? m_InlineSize : m_Tree.Size(); }
+    bool Empty() const { return Size() == 0; }
+
+    // get whether the entries are stored inline
+    bool IsInline() const { return m_IsInline; }
+
+    ConstReference Min() const { return m_IsInline ? Entry(0) : m_Tree.Min(); }
+    ConstReference Max() const { return m_IsInline ? Entry(m_InlineSize - 1) : m_Tree.Max(); }
+
+    // find entries in the tree
+    bool Contains(const KeyType& key) const
+    {
+        if (!m_IsInline) return m_Tree.Contains(key);
+
+        SizeType i = LowerBound(key);
+        return i < m_InlineSize && !(key < Entry(i).first);
+    }
+
+    ValueType& Find(const KeyType& key) { return m_IsInline ? Entry( LowerBound(key) ).second : m_Tree.Find(key); }
+    const ValueType& Find(const KeyType& key) const { return m_IsInline ? Entry( LowerBound(key) ).second : m_Tree.Find(key); }
+
+    // find the closest entries at or before, and at or after, a key
+    ConstPointer Predecessor(const KeyType& key) const
+    {
+        if (!m_IsInline) return m_Tree.Predecessor(key);
+
+        SizeType i = LowerBound(key);
+        if ( i < m_InlineSize && !(key < Entry(i).first) ) return &Entry(i);
+        return i > 0 ? &Entry(i - 1) : nullptr;
+    }
+
+    ConstPointer Successor(const KeyType& key) const
+    {
+        if (!m_IsInline) return m_Tree.Successor(key);
+
+        SizeType i = LowerBound(key);
+        return i < m_InlineSize ? &Entry(i) : nullptr;
+    }
+
+    // delete all the entries, and go back inline
+    void Clear()
+    {
+        ClearInline();
+        m_Tree.Clear();
+        m_IsInline = true;
+    }
+
+    /**
+     * @brief Inserts an entry into the tree.
+     * @param data The data of the new entry.
+     * 
+     * An entry with the same key is kept as it is. Inserting into a
+     * full inline array moves every entry into a node tree first.
+     */
+    void Insert(ConstReference data) { Emplace(data); }
+    void Insert(Pair&& data) { Emplace( std::move(data) ); }
+
+    /**
+     * @brief Removes an entry from the tree.
+     * @param key The key of the entry to remove.
+     * 
+     * A node tree that shrinks to the threshold moves back inline.
+     */
+    void Erase(const KeyType& key)
+    {
+        if (!m_IsInline)
+        {
+            m_Tree.Erase(key);
+            if ( !(m_Tree.Size() > INLINE_THRESHOLD) ) MoveInline();
+            return;
+        }
+
+        SizeType i = LowerBound(key);
+        if ( i == m_InlineSize || key < Entry(i).first ) return;
+
+        RemoveInline(i);
+    }
+
+    // remove the minimum and maximum entries
+    Pair PopMin()
+    {
+        if (m_IsInline) return RemoveInline(0);
+
+        Pair data = m_Tree.PopMin();
+        if ( !(m_Tree.Size() > INLINE_THRESHOLD) ) MoveInline();
+        return data;
+    }
+
+    Pair PopMax()
+    {
+        if (m_IsInline) return RemoveInline(m_InlineSize - 1);
+
+        Pair data = m_Tree.PopMax();
+        if ( !(m_Tree.Size() > INLINE_THRESHOLD) ) MoveInline();
+        return data;
+    }
+
+private:
+    // get an inline entry
+    Pair& Entry(SizeType i) { return reinterpret_cast<Pair*>(m_Inline)[i]; }
+    const Pair& Entry(SizeType i) const { return reinterpret_cast<const Pair*>(m_Inline)[i]; }
+
+    // find the first inline entry whose key is not less than a key,
+    // scanning from the front, which small arrays are fastest with
+    SizeType LowerBound(const KeyType& key) const
+    {
+        SizeType i = 0;
+        while ( i < m_InlineSize && Entry(i).first < key ) ++i;
+        return i;
+    }
+
+    /**
+     * @brief Inserts an entry.
+     * @param data The data of the new entry.
+     * 
+     * Shifts the larger inline entries up to make room, or moves to a
+     * node tree when there is no room left.
+     */
+    template<typename NewPair>
+    void Emplace(NewPair&& data)
+    {
+        if (!m_IsInline)
+        {
+            m_Tree.Insert( std::forward<NewPair>(data) );
+            return;
+        }
+
+        SizeType i = LowerBound(data.first);
+        if ( i < m_InlineSize && !(data.first < Entry(i).first) ) return;
+
+        if (m_InlineSize == InlineCapacity)
+        {
+            MoveToTree();
+            m_Tree.Insert( std::forward<NewPair>(data) );
+            return;
+        }
+
+        if (i == m_InlineSize) new ( &Entry(i) ) Pair( std::forward<NewPair>(data) );
+        else
+        {
+            new ( &Entry(m_InlineSize) ) Pair( std::move( Entry(m_InlineSize - 1) ) );
+            for (SizeType j = m_InlineSize - 1; j > i; --j)
+                Entry(j) = std::move( Entry(j - 1) );
+            Entry(i) = std::forward<NewPair>(data);
+        }
+
+        ++m_InlineSize;
+    }
+
+    // remove an inline entry, and shift the larger entries down
+    Pair RemoveInline(SizeType i)
+    {
+        Pair data = std::move( Entry(i) );
+
+        for (SizeType j = i + 1; j < m_InlineSize; ++j)
+            Entry(j - 1) = std::move( Entry(j) );
+
+        Entry(--m_InlineSize).~Pair();
+        return data;
+    }
+
+    // destruct the inline entries
+    void ClearInline()
+    {
+        for (SizeType i = 0; i < m_InlineSize; ++i)
+            Entry(i).~Pair();
+        m_InlineSize = 0;
+    }
+
+    /**
+     * @brief Moves the inline entries into a node tree.
+     * 
+     * The entries are in order, so they are built into a balanced tree
+     * rather than inserted one by one, which would make a list.
+     */
+    void MoveToTree()
+    {
+        std::vector<Pair> pairs;
+        pairs.reserve(m_InlineSize);
+        for (SizeType i = 0; i < m_InlineSize; ++i)
+            pairs.push_back( std::move( Entry(i) ) );
+
+        ClearInline();
+        m_Tree.BuildOptimal( pairs, std::vector<double>() );
+        m_IsInline = false;
+    }
+
+    // move the entries of the node tree back inline, in order
+    void MoveInline()
+    {
+        while ( !m_Tree.Empty() )
+            new ( &Entry(m_InlineSize++) ) Pair( m_Tree.PopMin() );
+
+        m_IsInline = true;
+    }
+};
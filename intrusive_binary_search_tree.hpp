@@ -0,0 +1,277 @@
+// This is a binary search tree of objects that hold their own links.
+// Each object has a hook member for every tree it can be in, so the
+// tree never allocates, and an object can be in several trees at
+// once. The tree does not own its objects: it only links and unlinks
+// them, and they must outlive their time in the tree.
+
+#pragma once
+
+#include <cstddef>
+#include <type_traits>
+#include <utility>
+
+// the links of an object in one tree
+template<typename T>
+struct BinarySearchTreeHook
+{
+    T* left = nullptr;
+    T* right = nullptr;
+};
+
+// objects are their own keys by default
+struct IntrusiveIdentity
+{
+    template<typename T>
+    const T& operator()(const T& object) const { return object; }
+};
+
+template< typename T,
+          BinarySearchTreeHook<T> T::*Hook,
+          typename KeyOfValue = IntrusiveIdentity >
+class IntrusiveBinarySearchTree
+{
+public:
+    using SizeType = std::size_t;
+    using KeyType  = typename std::decay< decltype( KeyOfValue()( std::declval<const T&>() ) ) >::type;
+
+private:
+    T* m_Root;
+    SizeType m_Size;
+
+public:
+    /**
+     * @brief Default constructor.
+     * 
+     * Creates a tree with nullptr as the root.
+     */
+    IntrusiveBinarySearchTree()
+        : m_Root(nullptr),
+          m_Size(0)
+    { }
+
+    // objects can only be linked into one tree through each hook
+    IntrusiveBinarySearchTree(const IntrusiveBinarySearchTree&) = delete;
+    IntrusiveBinarySearchTree& operator=(const IntrusiveBinarySearchTree&) = delete;
+
+    /**
+     * @brief Move constructor.
+     * @param other The tree to move.
+     * 
+     * Takes over the objects linked into the other tree.
+     */
+    IntrusiveBinarySearchTree(IntrusiveBinarySearchTree&& other)
+        : m_Root(other.m_Root),
+          m_Size(other.m_Size)
+    {
+        other.m_Root = nullptr;
+        other.m_Size = 0;
+    }
+
+    IntrusiveBinarySearchTree& operator=(IntrusiveBinarySearchTree&& other)
+    {
+        if (this == &other) return *this;
+
+        Clear();
+        m_Root = other.m_Root;
+        m_Size = other.m_Size;
+        other.m_Root = nullptr;
+        other.m_Size = 0;
+
+        return *this;
+    }
+
+    ~IntrusiveBinarySearchTree() { Clear(); }
+
+    T* Root() const { return m_Root; }
+    SizeType Size() const { return m_Size; }
+    bool Empty() const { return m_Size == 0; }
+
+    // get the objects with the smallest and largest keys, or nullptr
+    T* Min() const { return m_Root ? Min(m_Root) : nullptr; }
+    T* Max() const { return m_Root ? Max(m_Root) : nullptr; }
+
+    // find objects in the tree
+    bool Contains(const KeyType& key) const { return Find(key) != nullptr; }
+
+    T* Find(const KeyType& key) const
+    {
+        T* node = m_Root;
+
+        while (node != nullptr)
+        {
+            if ( key < KeyOf(*node) ) node = Links(node).left;
+            else if ( key > KeyOf(*node) ) node = Links(node).right;
+            else return node;
+        }
+
+        return nullptr;
+    }
+
+    /**
+     * @brief Links an object into the tree.
+     * @param object The object to link, whose hook must not be in use.
+     * @return Whether the object was linked, which it is not when an
+     *         object with the same key is already in the tree.
+     * 
+     * Finds the empty link the object belongs in, and never allocates.
+     */
+    bool Insert(T& object)
+    {
+        const KeyType& key = KeyOf(object);
+        T** link = &m_Root;
+
+        while (*link != nullptr)
+        {
+            if ( key < KeyOf(**link) ) link = &Links(*link).left;
+            else if ( key > KeyOf(**link) ) link = &Links(*link).right;
+            else return false;
+        }
+
+        Links(&object) = BinarySearchTreeHook<T>();
+        *link = &object;
+        ++m_Size;
+
+        return true;
+    }
+
+    /**
+     * @brief Unlinks an object from the tree.
+     * @param key The key of the object to unlink.
+     * @return The unlinked object, or nullptr if there was none.
+     * 
+     * An object with two children is replaced by the smallest object
+     * of its right subtree, which is moved up by relinking it, since
+     * objects cannot be copied over each other.
+     */
+    T* Erase(const KeyType& key)
+    {
+        T** link = &m_Root;
+
+        while ( *link != nullptr && ( key < KeyOf(**link) || key > KeyOf(**link) ) )
+            link = key < KeyOf(**link) ? &Links(*link).left : &Links(*link).right;
+
+        T* node = *link;
+        if (node == nullptr) return nullptr;
+
+        BinarySearchTreeHook<T>& links = Links(node);
+
+        if (links.left == nullptr) *link = links.right;
+        else if (links.right == nullptr) *link = links.left;
+        else
+        {
+            // unlink the successor, then put it in the node's place
+            T** successorLink = &links.right;
+            while (Links(*successorLink).left != nullptr)
+                successorLink = &Links(*successorLink).left;
+
+            T* successor = *successorLink;
+            *successorLink = Links(successor).right;
+
+            Links(successor).left = links.left;
+            Links(successor).right = links.right;
+            *link = successor;
+        }
+
+        links = BinarySearchTreeHook<T>();
+        --m_Size;
+
+        return node;
+    }
+
+    /**
+     * @brief Unlinks every object, which are left as they are otherwise.
+     * 
+     * Rotates each left child up until the object has none, and then
+     * resets its links, so neither a stack nor an allocation is needed
+     * however deep the tree is.
+     */
+    void Clear()
+    {
+        T* node = m_Root;
+
+        while (node != nullptr)
+        {
+            T* left = Links(node).left;
+
+            if (left != nullptr)
+            {
+                Links(node).left = Links(left).right;
+                Links(left).right = node;
+                node = left;
+            }
+            else
+            {
+                T* right = Links(node).right;
+                Links(node) = BinarySearchTreeHook<T>();
+                node = right;
+            }
+        }
+
+        m_Root = nullptr;
+        m_Size = 0;
+    }
+
+    /**
+     * @brief In order traversal.
+     * @param visit Called with each object, in key order.
+     * 
+     * Threads the right link of each object's predecessor back to it
+     * on the way down, and removes the thread on the way back up, so
+     * neither a stack nor an allocation is needed however deep the
+     * tree is. Every link is restored by the end, but visit must not
+     * look at or change the tree, and no other thread may read it
+     * meanwhile.
+     */
+    template<typename Function>
+    void ForEach(Function visit) const
+    {
+        T* node = m_Root;
+
+        while (node != nullptr)
+        {
+            T* left = Links(node).left;
+
+            if (left == nullptr)
+            {
+                visit(*node);
+                node = Links(node).right;
+                continue;
+            }
+
+            // the predecessor is the rightmost object of the left subtree,
+            // unless it is already threaded back to the node
+            T* predecessor = left;
+            while (Links(predecessor).right != nullptr && Links(predecessor).right != node)
+                predecessor = Links(predecessor).right;
+
+            if (Links(predecessor).right == nullptr)
+            {
+                Links(predecessor).right = node;
+                node = left;
+            }
+            else
+            {
+                Links(predecessor).right = nullptr;
+                visit(*node);
+                node = Links(node).right;
+            }
+        }
+    }
+
+private:
+    // get the links and key of an object
+    static BinarySearchTreeHook<T>& Links(T* node) { return node->*Hook; }
+    static auto KeyOf(const T& object) -> decltype( KeyOfValue()(object) ) { return KeyOfValue()(object); }
+
+    static T* Min(T* node)
+    {
+        while (Links(node).left) node = Links(node).left;
+        return node;
+    }
+
+    static T* Max(T* node)
+    {
+        while (Links(node).right) node = Links(node).right;
+        return node;
+    }
+};
@@ -0,0 +1,256 @@
+// This is a latency histogram in the style of HdrHistogram. Values
+// are counted in log-linear buckets, where every power of two is
+// split into equal sub-buckets, so quantiles keep a fixed relative
+// precision. Counts are spread over per-thread shards, which are
+// merged when the histogram is read.
+
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <thread>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+/**
+ * @brief Reads the cheapest available clock.
+ * @return The current time in ticks.
+ *
+ * Uses the time stamp counter on x86, and a steady clock in
+ * nanoseconds everywhere else.
+ */
+inline std::uint64_t LatencyTicks()
+{
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch() ).count();
+#endif
+}
+
+/**
+ * @brief Measures the speed of the tick clock.
+ * @return The number of ticks per nanosecond.
+ *
+ * Calibrates the ticks against a steady clock once, the first time
+ * it is called.
+ */
+inline double LatencyTicksPerNanosecond()
+{
+#if defined(__x86_64__) || defined(__i386__)
+    static const double ticksPerNanosecond = []
+    {
+        using Clock = std::chrono::steady_clock;
+
+        Clock::time_point start = Clock::now();
+        std::uint64_t startTicks = LatencyTicks();
+        while ( Clock::now() - start < std::chrono::milliseconds(10) ) { }
+
+        std::uint64_t ticks = LatencyTicks() - startTicks;
+        double nanoseconds = std::chrono::duration<double, std::nano>( Clock::now() - start ).count();
+
+        return ticks / nanoseconds;
+    }();
+
+    return ticksPerNanosecond;
+#else
+    return 1.0;
+#endif
+}
+
+class LatencyHistogram
+{
+public:
+    using SizeType = std::size_t;
+    using CountType = std::uint64_t;
+
+    // every power of two is split into 2^SUB_BUCKET_BITS buckets
+    static constexpr SizeType SUB_BUCKET_BITS = 4;
+    static constexpr SizeType SUB_BUCKETS = SizeType(1) << SUB_BUCKET_BITS;
+    static constexpr SizeType BUCKETS = (64 - SUB_BUCKET_BITS + 1) * SUB_BUCKETS;
+
+    // the number of shards that threads are spread over
+    static constexpr SizeType SHARDS = 8;
+
+private:
+    // shards are aligned so that threads do not share cache lines
+    struct alignas(64) Shard
+    {
+        std::array<std::atomic<CountType>, BUCKETS> counts{};
+
+        // the sum of the recorded values, exact rather than bucketed
+        std::atomic<std::uint64_t> sum{0};
+    };
+
+    std::array<Shard, SHARDS> m_Shards;
+
+public:
+    LatencyHistogram() = default;
+    LatencyHistogram(const LatencyHistogram&) = delete;
+    LatencyHistogram& operator=(const LatencyHistogram&) = delete;
+
+    /**
+     * @brief Records a value.
+     * @param value The value to count.
+     *
+     * Adds one to the value's bucket in the calling thread's shard,
+     * and the value to the shard's sum.
+     */
+    void Record(std::uint64_t value)
+    {
+        Shard& shard = m_Shards[ ShardIndex() ];
+        shard.counts[ BucketIndex(value) ].fetch_add(1, std::memory_order_relaxed);
+        shard.sum.fetch_add(value, std::memory_order_relaxed);
+    }
+
+    /**
+     * @brief Merges the shards.
+     * @param counts The merged count of every bucket.
+     * @return The total number of recorded values.
+     *
+     * Sums every bucket over all of the shards.
+     */
+    CountType Merge(std::array<CountType, BUCKETS>& counts) const
+    {
+        CountType total = 0;
+        counts.fill(0);
+
+        for (const Shard& shard : m_Shards)
+        {
+            for (SizeType i = 0; i < BUCKETS; ++i)
+                counts[i] += shard.counts[i].load(std::memory_order_relaxed);
+        }
+
+        for (CountType count : counts)
+            total += count;
+
+        return total;
+    }
+
+    // get the number of recorded values
+    CountType Count() const
+    {
+        std::array<CountType, BUCKETS> counts;
+        return Merge(counts);
+    }
+
+    // get the sum of the recorded values
+    std::uint64_t Sum() const
+    {
+        std::uint64_t sum = 0;
+        for (const Shard& shard : m_Shards)
+            sum += shard.sum.load(std::memory_order_relaxed);
+
+        return sum;
+    }
+
+    /**
+     * @brief Finds a quantile.
+     * @param quantile The quantile to find, between 0 and 1.
+     * @return The largest value in the quantile's bucket, or 0.
+     *
+     * Walks the merged buckets until the quantile's rank is reached.
+     */
+    std::uint64_t Quantile(double quantile) const
+    {
+        std::array<CountType, BUCKETS> counts;
+        CountType total = Merge(counts);
+        if (total == 0) return 0;
+
+        CountType rank = static_cast<CountType>(quantile * total);
+        if (rank >= total) rank = total - 1;
+
+        CountType seen = 0;
+        for (SizeType i = 0; i < BUCKETS; ++i)
+        {
+            seen += counts[i];
+            if (seen > rank) return BucketMax(i);
+        }
+
+        return BucketMax(BUCKETS - 1);
+    }
+
+    // zero every bucket
+    void Reset()
+    {
+        for (Shard& shard : m_Shards)
+        {
+            for (std::atomic<CountType>& count : shard.counts)
+                count.store(0, std::memory_order_relaxed);
+            shard.sum.store(0, std::memory_order_relaxed);
+        }
+    }
+
+    /**
+     * @brief Finds the bucket of a value.
+     * @param value The value to find the bucket of.
+     * @return The index of the bucket.
+     *
+     * Small values have a bucket each. Larger values are bucketed by
+     * their highest bit, and then by the bits just below it.
+     */
+    static SizeType BucketIndex(std::uint64_t value)
+    {
+        if (value < SUB_BUCKETS) return static_cast<SizeType>(value);
+
+        SizeType highestBit = 63 - __builtin_clzll(value);
+        SizeType shift = highestBit - SUB_BUCKET_BITS;
+
+        return (shift + 1) * SUB_BUCKETS + static_cast<SizeType>( (value >> shift) - SUB_BUCKETS );
+    }
+
+    /**
+     * @brief Finds the largest value of a bucket.
+     * @param index The index of the bucket.
+     * @return The largest value counted in the bucket.
+     */
+    static std::uint64_t BucketMax(SizeType index)
+    {
+        if (index < SUB_BUCKETS) return index;
+
+        SizeType shift = index / SUB_BUCKETS - 1;
+        std::uint64_t subBucket = index % SUB_BUCKETS + SUB_BUCKETS;
+
+        return ( (subBucket + 1) << shift ) - 1;
+    }
+
+private:
+    // each thread is given a shard, in turn, the first time it records
+    static SizeType ShardIndex()
+    {
+        static std::atomic<SizeType> nextShard{0};
+        thread_local SizeType shard = nextShard.fetch_add(1, std::memory_order_relaxed) % SHARDS;
+        return shard;
+    }
+};
+
+// This times a scope, and records its latency in a histogram when it
+// ends. Nothing is timed when there is no histogram, unless the
+// elapsed time is asked for.
+class LatencyTimer
+{
+    LatencyHistogram* m_Histogram;
+    std::uint64_t m_Start;
+
+public:
+    explicit LatencyTimer(LatencyHistogram* histogram, bool timed = false)
+        : m_Histogram(histogram),
+          m_Start( histogram || timed ? LatencyTicks() : 0 )
+    { }
+
+    LatencyTimer(const LatencyTimer&) = delete;
+    LatencyTimer& operator=(const LatencyTimer&) = delete;
+
+    // get the ticks since the timer started, if it was timed
+    std::uint64_t Elapsed() const { return LatencyTicks() - m_Start; }
+
+    ~LatencyTimer()
+    {
+        if (m_Histogram) m_Histogram->Record( LatencyTicks() - m_Start );
+    }
+};
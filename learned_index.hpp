@@ -0,0 +1,277 @@
+// This is a learned index over a frozen, sorted snapshot of a tree
+// with integer keys, in the style of the PGM-index. The keys are
+// covered by line segments that each predict the position of a key
+// to within Epsilon places. The first keys of the segments are in
+// turn covered by a smaller level of segments, and so on up to a
+// single segment. A lookup walks down the levels, and at each one
+// predicts a position and searches only the small window around it.
+//
+// Segments are fit in one pass with a shrinking cone: each segment is
+// anchored at its first key, and grows while some slope still keeps
+// every key it covers within Epsilon places.
+
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "binary_search_tree.hpp"
+
+template<typename KeyType, typename ValueType>
+class LearnedIndex
+{
+    static_assert(std::is_integral<KeyType>::value, "learned indexes need integer keys");
+
+public:
+    using SizeType = std::size_t;
+
+private:
+    // a line predicting the positions of the keys from first onwards
+    struct Segment
+    {
+        KeyType first;
+        SizeType start;
+        double slope;
+    };
+
+    SizeType m_Epsilon;
+    std::vector<KeyType> m_Keys;
+    std::vector<ValueType> m_Values;
+
+    // the segments of each level, from the ones over the keys up to
+    // a single segment
+    std::vector< std::vector<Segment> > m_Levels;
+
+    // the first keys of the segments of each level but the top one,
+    // covered by the segments of the level above
+    std::vector< std::vector<KeyType> > m_LevelKeys;
+
+public:
+    /**
+     * @brief Default constructor.
+     * @param epsilon The most places a prediction can be off by.
+     * 
+     * Creates an empty index. A lookup searches 2 * epsilon + 3 keys
+     * on each level, so the default of 4 keeps the last search within
+     * two cache lines of 8-byte keys. A larger epsilon takes fewer
+     * segments and levels, at the cost of a wider search.
+     */
+    explicit LearnedIndex(SizeType epsilon = 4)
+        : m_Epsilon(epsilon)
+    { }
+
+    /**
+     * @brief Builds the index from a tree.
+     * @param tree The tree to take a snapshot of.
+     * 
+     * Copies the keys and values in order, and fits the segments. The
+     * index does not follow later changes to the tree.
+     */
+    template<typename KeyOfValue, unsigned Features>
+    void Build(const BinarySearchTree<KeyType, ValueType, KeyOfValue, Features>& tree)
+    {
+        m_Keys.clear();
+        m_Values.clear();
+        m_Keys.reserve( tree.Size() );
+        m_Values.reserve( tree.Size() );
+
+        tree.ForEach([this](const typename BinarySearchTree<KeyType, ValueType, KeyOfValue, Features>::Pair& data)
+        {
+            m_Keys.push_back( BinarySearchTreeData<KeyType, ValueType, KeyOfValue>::Key(data) );
+            m_Values.push_back( BinarySearchTreeData<KeyType, ValueType, KeyOfValue>::Value(data) );
+        });
+
+        Fit();
+    }
+
+    SizeType Size() const { return m_Keys.size(); }
+    bool Empty() const { return m_Keys.empty(); }
+    SizeType Epsilon() const { return m_Epsilon; }
+    SizeType Segments() const { return m_Levels.empty() ? 0 : m_Levels[0].size(); }
+    SizeType Levels() const { return m_Levels.size(); }
+
+    // get the memory used by the segments, beyond the keys and values
+    SizeType IndexBytes() const
+    {
+        SizeType bytes = 0;
+        for (const std::vector<Segment>& level : m_Levels)
+            bytes += level.size() * sizeof(Segment);
+        for (const std::vector<KeyType>& keys : m_LevelKeys)
+            bytes += keys.size() * sizeof(KeyType);
+
+        return bytes;
+    }
+
+    // get the key and value at a position
+    const KeyType& Key(SizeType i) const { return m_Keys[i]; }
+    const ValueType& Value(SizeType i) const { return m_Values[i]; }
+
+    // find keys in the index
+    bool Contains(const KeyType& key) const
+    {
+        SizeType i = LowerBound(key);
+        return i < m_Keys.size() && !(key < m_Keys[i]);
+    }
+
+    const ValueType& Find(const KeyType& key) const { return m_Values[ LowerBound(key) ]; }
+
+    /**
+     * @brief Finds the place of a key.
+     * @param key The key to search for.
+     * @return The position of the first key not less than key.
+     * 
+     * Walks down from the top level, finding the segment of the key on
+     * each level with a window search of the level below.
+     */
+    SizeType LowerBound(const KeyType& key) const
+    {
+        if ( m_Keys.empty() ) return 0;
+
+        SizeType segment = 0;
+        for (SizeType level = m_Levels.size() - 1; level > 0; --level)
+        {
+            SizeType next = Search(m_LevelKeys[level - 1], m_Levels[level], segment, key, true);
+            segment = next > 0 ? next - 1 : 0;
+        }
+
+        return Search(m_Keys, m_Levels[0], segment, key, false);
+    }
+
+private:
+    /**
+     * @brief Searches a window of keys around a prediction.
+     * @param keys The keys the segments cover.
+     * @param segments The segments over the keys.
+     * @param segment The segment the key is routed to.
+     * @param key The key to search for.
+     * @param upper Whether to find the first key greater than key,
+     *              rather than the first key not less than it.
+     * @return The position of the key among the keys.
+     * 
+     * A key that lands outside its window, which rounding can cause,
+     * falls back to a search of all the keys.
+     */
+    SizeType Search(const std::vector<KeyType>& keys, const std::vector<Segment>& segments,
+                    SizeType segment, const KeyType& key, bool upper) const
+    {
+        // the place of any key routed to a segment is at or before the
+        // start of the next segment
+        SizeType start = segments[segment].start;
+        SizeType end = segment + 1 < segments.size() ? segments[segment + 1].start : keys.size();
+        SizeType predicted = Predict(segments[segment], key, start, end);
+
+        SizeType first = predicted > start + m_Epsilon + 1 ? predicted - m_Epsilon - 1 : start;
+        SizeType last = std::min(predicted + m_Epsilon + 2, end);
+
+        // whether a key comes before the place searched for
+        auto before = [&key, upper](const KeyType& other) { return upper ? !(key < other) : other < key; };
+
+        SizeType i = upper ? std::upper_bound(keys.begin() + first, keys.begin() + last, key) - keys.begin()
+                           : std::lower_bound(keys.begin() + first, keys.begin() + last, key) - keys.begin();
+
+        bool inWindow = ( i > first || first == 0 || before( keys[first - 1] ) ) &&
+                        ( i < last || last == keys.size() || !before( keys[last] ) );
+        if (inWindow) return i;
+
+        return upper ? std::upper_bound(keys.begin(), keys.end(), key) - keys.begin()
+                     : std::lower_bound(keys.begin(), keys.end(), key) - keys.begin();
+    }
+
+    // predict the position of a key, between the start and end of a segment
+    static SizeType Predict(const Segment& segment, const KeyType& key, SizeType start, SizeType end)
+    {
+        if ( !(segment.first < key) ) return start;
+
+        double offset = segment.slope * static_cast<double>( Distance(segment.first, key) );
+        if ( !(offset < static_cast<double>(end - start)) ) return end;
+
+        return start + static_cast<SizeType>(offset);
+    }
+
+    // get how far apart two keys are, without overflowing
+    static std::uint64_t Distance(const KeyType& from, const KeyType& to)
+    {
+        using Unsigned = typename std::make_unsigned<KeyType>::type;
+        return static_cast<Unsigned>( static_cast<Unsigned>(to) - static_cast<Unsigned>(from) );
+    }
+
+    /**
+     * @brief Fits the levels of segments.
+     * 
+     * Fits the bottom level to the keys, then each level to the first
+     * keys of the level below, until a level has a single segment.
+     * Every segment covers at least two keys, so each level is at most
+     * half the size of the one below.
+     */
+    void Fit()
+    {
+        m_Levels.clear();
+        m_LevelKeys.clear();
+        if ( m_Keys.empty() ) return;
+
+        m_Levels.emplace_back( Fit(m_Keys) );
+        while (m_Levels.back().size() > 1)
+        {
+            std::vector<KeyType> keys;
+            keys.reserve( m_Levels.back().size() );
+            for (const Segment& s : m_Levels.back())
+                keys.push_back(s.first);
+
+            m_LevelKeys.push_back( std::move(keys) );
+            m_Levels.emplace_back( Fit( m_LevelKeys.back() ) );
+        }
+    }
+
+    /**
+     * @brief Fits segments to sorted keys.
+     * @param keys The keys to cover.
+     * @return The segments, in order.
+     * 
+     * Each key narrows the cone of slopes that keep it within Epsilon
+     * places of its segment's line. A key that would close the cone
+     * starts a new segment instead, and the finished segment takes the
+     * slope in the middle of its cone.
+     */
+    std::vector<Segment> Fit(const std::vector<KeyType>& keys) const
+    {
+        std::vector<Segment> segments;
+
+        double epsilon = static_cast<double>(m_Epsilon);
+        double low = 0;
+        double high = std::numeric_limits<double>::infinity();
+        Segment segment{ keys[0], 0, 0 };
+
+        for (SizeType i = 1; i < keys.size(); ++i)
+        {
+            double distance = static_cast<double>( Distance(segment.first, keys[i]) );
+            double places = static_cast<double>(i - segment.start);
+
+            double keyLow = std::max( (places - epsilon) / distance, 0.0 );
+            double keyHigh = (places + epsilon) / distance;
+
+            if (keyLow > high || keyHigh < low)
+            {
+                segment.slope = high == std::numeric_limits<double>::infinity() ? low : (low + high) / 2;
+                segments.push_back(segment);
+
+                segment = Segment{ keys[i], i, 0 };
+                low = 0;
+                high = std::numeric_limits<double>::infinity();
+                continue;
+            }
+
+            low = std::max(low, keyLow);
+            high = std::min(high, keyHigh);
+        }
+
+        segment.slope = high == std::numeric_limits<double>::infinity() ? low : (low + high) / 2;
+        segments.push_back(segment);
+
+        return segments;
+    }
+};
@@ -0,0 +1,205 @@
+// This renders the runtime statistics of a binary search tree in the
+// Prometheus text exposition format. The text is written into a
+// buffer provided by the caller, and nothing is allocated.
+//
+// The size, tombstone and memory gauges are plain reads of the tree,
+// so the exporter must run on the thread that writes the tree, or
+// under a lock that keeps writers out, such as the shared lock of a
+// reader. The operation counts and latencies are atomic, and can be
+// read from any thread. The height and node depths take a walk of the
+// whole tree, so they are measured into a TreeShape only on request,
+// under the same rules, and the last measurement is exported with
+// each scrape.
+
+#pragma once
+
+#include <cstdarg>
+#include <cstdio>
+
+#include "binary_search_tree.hpp"
+
+class PrometheusWriter
+{
+public:
+    using SizeType = std::size_t;
+
+private:
+    char* m_Buffer;
+    SizeType m_Capacity;
+    SizeType m_Length;
+
+public:
+    /**
+     * @brief Default constructor.
+     * @param buffer The buffer to write into.
+     * @param capacity The size of the buffer, in bytes.
+     * 
+     * Creates a writer that has not written anything yet.
+     */
+    PrometheusWriter(char* buffer, SizeType capacity)
+        : m_Buffer(buffer),
+          m_Capacity(capacity),
+          m_Length(0)
+    {
+        if (m_Capacity > 0) m_Buffer[0] = '\0';
+    }
+
+    // get the length of everything written, even if it did not fit
+    SizeType Length() const { return m_Length; }
+    bool Fits() const { return m_Length < m_Capacity; }
+
+    /**
+     * @brief Writes formatted text.
+     * @param format The printf format of the text.
+     * 
+     * Writes as much of the text as fits, and always keeps the buffer
+     * terminated.
+     */
+    void Write(const char* format, ...)
+    {
+        char* end = m_Length < m_Capacity ? m_Buffer + m_Length : nullptr;
+        SizeType space = end ? m_Capacity - m_Length : 0;
+
+        va_list args;
+        va_start(args, format);
+        int written = std::vsnprintf(end, space, format, args);
+        va_end(args);
+
+        if (written > 0) m_Length += static_cast<SizeType>(written);
+    }
+
+    // write the HELP and TYPE lines of a metric
+    void Header(const char* prefix, const char* name, const char* type, const char* help)
+    {
+        Write("# HELP %s_%s %s\n", prefix, name, help);
+        Write("# TYPE %s_%s %s\n", prefix, name, type);
+    }
+};
+
+// the height and node depths of a tree, as of its last measurement
+struct TreeShape
+{
+    using SizeType = std::size_t;
+
+    // nodes are counted at exact depths, and reported at powers of two
+    static constexpr SizeType DEPTHS = 65;
+    static constexpr SizeType DEPTH_BUCKETS = 7;
+
+    SizeType height = 0;
+    SizeType depths[DEPTHS] = {};
+};
+
+/**
+ * @brief Measures the shape of a tree.
+ * @param tree The tree to measure.
+ * @param shape The shape to overwrite.
+ * 
+ * Walks the whole tree once, without recursing. It must not run while
+ * the tree is being written, and is meant to be called far less often
+ * than the tree is scraped.
+ */
+template<typename KeyType, typename ValueType, typename KeyOfValue, unsigned Features>
+void MeasureShape(const BinarySearchTree<KeyType, ValueType, KeyOfValue, Features>& tree, TreeShape& shape)
+{
+    shape = TreeShape();
+    shape.height = tree.DepthHistogram(shape.depths, TreeShape::DEPTHS);
+}
+
+/**
+ * @brief Writes the statistics of a tree.
+ * @param tree The tree to describe.
+ * @param buffer The buffer to write into.
+ * @param capacity The size of the buffer, in bytes.
+ * @param prefix The prefix of every metric name.
+ * @param shape The last measured shape of the tree, or nullptr to
+ *              leave out the height and node depths.
+ * @return The length of the text, which did not fit if it is not less
+ *         than the capacity.
+ * 
+ * Writes the size, height, node depths, node memory, and the operation
+ * counts and latency summaries when the tree records them. It takes
+ * constant time, and must not run while the tree is being written.
+ */
+template<typename KeyType, typename ValueType, typename KeyOfValue, unsigned Features>
+std::size_t WritePrometheus( const BinarySearchTree<KeyType, ValueType, KeyOfValue, Features>& tree,
+                             char* buffer,
+                             std::size_t capacity,
+                             const char* prefix = "bst",
+                             const TreeShape* shape = nullptr )
+{
+    using Tree = BinarySearchTree<KeyType, ValueType, KeyOfValue, Features>;
+    using SizeType = typename Tree::SizeType;
+
+    PrometheusWriter out(buffer, capacity);
+
+    out.Header(prefix, "size", "gauge", "Number of entries in the tree.");
+    out.Write("%s_size %zu\n", prefix, tree.Size());
+
+    out.Header(prefix, "tombstones", "gauge", "Number of erased nodes waiting to be purged.");
+    out.Write("%s_tombstones %zu\n", prefix, tree.Tombstones());
+
+    if (shape)
+    {
+        out.Header(prefix, "height", "gauge", "Number of levels of the tree, as last measured.");
+        out.Write("%s_height %zu\n", prefix, shape->height);
+
+        SizeType nodes = 0;
+        SizeType depthSum = 0;
+        SizeType bucket = 0;
+
+        out.Header(prefix, "node_depth", "histogram", "Depth of each node, where the root is at depth 1.");
+        for (SizeType depth = 0; depth < TreeShape::DEPTHS; ++depth)
+        {
+            nodes += shape->depths[depth];
+            depthSum += shape->depths[depth] * (depth + 1);
+
+            // the buckets end at depths 1, 2, 4, ..., 64
+            if ( bucket < TreeShape::DEPTH_BUCKETS && depth + 1 == (SizeType(1) << bucket) )
+            {
+                out.Write("%s_node_depth_bucket{le=\"%zu\"} %zu\n", prefix, depth + 1, nodes);
+                ++bucket;
+            }
+        }
+        out.Write("%s_node_depth_bucket{le=\"+Inf\"} %zu\n", prefix, nodes);
+        out.Write("%s_node_depth_sum %zu\n", prefix, depthSum);
+        out.Write("%s_node_depth_count %zu\n", prefix, nodes);
+    }
+
+    typename Tree::MemoryStats memory = tree.MemoryUsage();
+    out.Header(prefix, "node_bytes", "gauge", "Bytes of node memory, by whether it is in use.");
+    out.Write("%s_node_bytes{state=\"live\"} %zu\n", prefix, memory.liveBytes);
+    out.Write("%s_node_bytes{state=\"reserved\"} %zu\n", prefix, memory.reservedBytes);
+
+    const typename Tree::OperationStats* stats = tree.Stats();
+    if (stats == nullptr) return out.Length();
+
+    static const char* const NAMES[Tree::OPERATION_COUNT] = { "insert", "find", "erase", "copy", "clear" };
+    static const double QUANTILES[] = { 0.5, 0.99, 0.999 };
+    double ticksPerSecond = LatencyTicksPerNanosecond() * 1e9;
+
+    out.Header(prefix, "operations_total", "counter", "Number of operations performed.");
+    for (SizeType i = 0; i < Tree::OPERATION_COUNT; ++i)
+    {
+        unsigned long long count = stats->latency[i].Count();
+        out.Write("%s_operations_total{op=\"%s\"} %llu\n", prefix, NAMES[i], count);
+    }
+
+    out.Header(prefix, "operation_latency_seconds", "summary", "Latency of each operation.");
+    for (SizeType i = 0; i < Tree::OPERATION_COUNT; ++i)
+    {
+        const LatencyHistogram& latency = stats->latency[i];
+        for (double quantile : QUANTILES)
+        {
+            double seconds = latency.Quantile(quantile) / ticksPerSecond;
+            out.Write( "%s_operation_latency_seconds{op=\"%s\",quantile=\"%g\"} %.9g\n",
+                       prefix, NAMES[i], quantile, seconds );
+        }
+
+        unsigned long long count = latency.Count();
+        out.Write( "%s_operation_latency_seconds_sum{op=\"%s\"} %.9g\n",
+                   prefix, NAMES[i], latency.Sum() / ticksPerSecond );
+        out.Write("%s_operation_latency_seconds_count{op=\"%s\"} %llu\n", prefix, NAMES[i], count);
+    }
+
+    return out.Length();
+}
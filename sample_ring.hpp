@@ -0,0 +1,139 @@
+// This is a bounded, lock-free ring buffer of samples, after Dmitry
+// Vyukov's multi-producer multi-consumer queue. Any number of threads
+// can push samples while others pop them. A push never waits: when
+// the ring is full the sample is dropped and counted instead.
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+
+template<typename SampleType>
+class SampleRing
+{
+public:
+    using SizeType = std::size_t;
+
+private:
+    struct Cell
+    {
+        // the position the cell is ready for, which tells producers and
+        // consumers whether it is empty or full
+        std::atomic<SizeType> sequence;
+        SampleType sample;
+    };
+
+    std::unique_ptr<Cell[]> m_Cells;
+    SizeType m_Mask;
+
+    // producers and consumers are kept on separate cache lines
+    alignas(64) std::atomic<SizeType> m_Head;
+    alignas(64) std::atomic<SizeType> m_Tail;
+    alignas(64) std::atomic<SizeType> m_Dropped;
+
+public:
+    /**
+     * @brief Default constructor.
+     * @param capacity The number of samples to hold, which is rounded
+     *                 up to a power of two.
+     *
+     * Creates an empty ring.
+     */
+    explicit SampleRing(SizeType capacity = 1024)
+        : m_Mask(0),
+          m_Head(0),
+          m_Tail(0),
+          m_Dropped(0)
+    {
+        SizeType size = 2;
+        while (size < capacity) size *= 2;
+
+        m_Cells.reset( new Cell[size] );
+        m_Mask = size - 1;
+
+        for (SizeType i = 0; i < size; ++i)
+            m_Cells[i].sequence.store(i, std::memory_order_relaxed);
+    }
+
+    SampleRing(const SampleRing&) = delete;
+    SampleRing& operator=(const SampleRing&) = delete;
+
+    // get the number of samples that did not fit
+    SizeType Dropped() const { return m_Dropped.load(std::memory_order_relaxed); }
+    SizeType Capacity() const { return m_Mask + 1; }
+
+    /**
+     * @brief Adds a sample.
+     * @param sample The sample to add.
+     * @return Whether the sample fit.
+     *
+     * Claims the cell at the head, unless it has not been popped yet.
+     */
+    bool TryPush(const SampleType& sample)
+    {
+        SizeType position = m_Head.load(std::memory_order_relaxed);
+
+        while (1)
+        {
+            Cell& cell = m_Cells[position & m_Mask];
+            SizeType sequence = cell.sequence.load(std::memory_order_acquire);
+
+            // the cell is empty, so try to claim it
+            if (sequence == position)
+            {
+                if ( m_Head.compare_exchange_weak(position, position + 1, std::memory_order_relaxed) )
+                {
+                    cell.sample = sample;
+                    cell.sequence.store(position + 1, std::memory_order_release);
+                    return true;
+                }
+            }
+
+            // the cell still holds a sample from the previous lap
+            else if (sequence < position)
+            {
+                m_Dropped.fetch_add(1, std::memory_order_relaxed);
+                return false;
+            }
+
+            // another producer claimed the cell first
+            else position = m_Head.load(std::memory_order_relaxed);
+        }
+    }
+
+    /**
+     * @brief Removes the oldest sample.
+     * @param sample Where to put the removed sample.
+     * @return Whether there was a sample.
+     *
+     * Claims the cell at the tail, if a producer has filled it.
+     */
+    bool TryPop(SampleType& sample)
+    {
+        SizeType position = m_Tail.load(std::memory_order_relaxed);
+
+        while (1)
+        {
+            Cell& cell = m_Cells[position & m_Mask];
+            SizeType sequence = cell.sequence.load(std::memory_order_acquire);
+
+            // the cell is full, so try to claim it
+            if (sequence == position + 1)
+            {
+                if ( m_Tail.compare_exchange_weak(position, position + 1, std::memory_order_relaxed) )
+                {
+                    sample = cell.sample;
+                    cell.sequence.store(position + m_Mask + 1, std::memory_order_release);
+                    return true;
+                }
+            }
+
+            // the ring is empty
+            else if (sequence < position + 1) return false;
+
+            // another consumer claimed the cell first
+            else position = m_Tail.load(std::memory_order_relaxed);
+        }
+    }
+};
@@ -0,0 +1,483 @@
+// This is a binary search tree with a fixed capacity, whose nodes are
+// stored inline in the tree itself. It never allocates, so every
+// operation takes a bounded time that depends only on the height of
+// the tree. Nodes link to their children by 16-bit indices, and freed
+// nodes are kept in a free list for reuse.
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <iostream>
+#include <new>
+#include <utility>
+
+template<typename KeyType, typename ValueType, std::size_t Capacity>
+class StaticBinarySearchTree
+{
+    static_assert(Capacity > 0 && Capacity < 0xffff, "the capacity must fit in a 16-bit index");
+
+public:
+    using SizeType       = std::size_t;
+    using IndexType      = std::uint16_t;
+    using Pair           = std::pair<KeyType, ValueType>;
+    using Pointer        = Pair*;
+    using ConstPointer   = const Pair*;
+    using Reference      = Pair&;
+    using ConstReference = const Pair&;
+
+    // the index of no node
+    static constexpr IndexType NIL = 0xffff;
+
+private:
+    struct StaticNode
+    {
+        // the data is only constructed while the node is in the tree
+        alignas(Pair) unsigned char data[ sizeof(Pair) ];
+
+        // the children of the node, or the next free node
+        IndexType left;
+        IndexType right;
+    };
+
+    StaticNode m_Nodes[Capacity];
+    IndexType m_Root;
+    SizeType m_Size;
+
+    // freed nodes, and the number of nodes ever used
+    IndexType m_Free;
+    SizeType m_Used;
+
+public:
+    /**
+     * @brief Default constructor.
+     * 
+     * Creates an empty tree, without touching its nodes.
+     */
+    StaticBinarySearchTree()
+        : m_Root(NIL),
+          m_Size(0),
+          m_Free(NIL),
+          m_Used(0)
+    { }
+
+    /**
+     * @brief Copy constructor.
+     * @param other The tree to copy.
+     * 
+     * Copies the nodes of the other tree into the same places.
+     */
+    StaticBinarySearchTree(const StaticBinarySearchTree& other)
+        : StaticBinarySearchTree()
+    {
+        CopyFrom(other);
+    }
+
+    ~StaticBinarySearchTree() { Clear(); }
+
+    /**
+     * @brief Copy assignment operator.
+     * @param other The tree to copy.
+     * 
+     * Recreates the tree by copying the nodes of the other.
+     */
+    StaticBinarySearchTree& operator=(const StaticBinarySearchTree& other)
+    {
+        if (this == &other) return *this;
+
+        Clear();
+        CopyFrom(other);
+
+        return *this;
+    }
+
+    ConstReference Root() const { return Data(m_Root); }
+    SizeType Size() const { return m_Size; }
+    bool Empty() const { return m_Size == 0; }
+    bool Full() const { return m_Size == Capacity; }
+    static constexpr SizeType MaxSize() { return Capacity; }
+
+    SizeType Height() const { return ForEachLevel( [](IndexType, SizeType) { } ); }
+
+    // get the data with the smallest and largest keys
+    ConstReference Min() const { return Data( Min(m_Root) ); }
+    ConstReference Max() const { return Data( Max(m_Root) ); }
+
+    /**
+     * @brief Removes the minimum node.
+     * @return The data of the removed node.
+     * 
+     * The tree must not be empty.
+     */
+    Pair PopMin()
+    {
+        IndexType* link = &m_Root;
+        while (m_Nodes[*link].left != NIL)
+            link = &m_Nodes[*link].left;
+
+        IndexType node = *link;
+        *link = m_Nodes[node].right;
+
+        return Release(node);
+    }
+
+    Pair PopMax()
+    {
+        IndexType* link = &m_Root;
+        while (m_Nodes[*link].right != NIL)
+            link = &m_Nodes[*link].right;
+
+        IndexType node = *link;
+        *link = m_Nodes[node].left;
+
+        return Release(node);
+    }
+
+    // find nodes in the tree
+    bool Contains(const KeyType& key) const { return Find(key, m_Root) != NIL; }
+    ValueType& Find(const KeyType& key) { return Data( Find(key, m_Root) ).second; }
+    const ValueType& Find(const KeyType& key) const { return Data( Find(key, m_Root) ).second; }
+
+    /**
+     * @brief Finds the closest node at or before a key.
+     * @param key The key to search for.
+     * @return The data with the largest key not greater than key, or
+     *         nullptr if there is none.
+     * 
+     * Descends towards the key, remembering the last right turn.
+     */
+    ConstPointer Predecessor(const KeyType& key) const
+    {
+        IndexType node = m_Root;
+        IndexType lastRight = NIL;
+
+        while (node != NIL)
+        {
+            if (key < Data(node).first)
+                node = m_Nodes[node].left;
+
+            else if (key > Data(node).first)
+            {
+                lastRight = node;
+                node = m_Nodes[node].right;
+            }
+
+            else return &Data(node);
+        }
+
+        return lastRight == NIL ? nullptr : &Data(lastRight);
+    }
+
+    /**
+     * @brief Finds the closest node at or after a key.
+     * @param key The key to search for.
+     * @return The data with the smallest key not less than key, or
+     *         nullptr if there is none.
+     * 
+     * Descends towards the key, remembering the last left turn.
+     */
+    ConstPointer Successor(const KeyType& key) const
+    {
+        IndexType node = m_Root;
+        IndexType lastLeft = NIL;
+
+        while (node != NIL)
+        {
+            if (key > Data(node).first)
+                node = m_Nodes[node].right;
+
+            else if (key < Data(node).first)
+            {
+                lastLeft = node;
+                node = m_Nodes[node].left;
+            }
+
+            else return &Data(node);
+        }
+
+        return lastLeft == NIL ? nullptr : &Data(lastLeft);
+    }
+
+    /**
+     * @brief Deletes all the nodes in the tree.
+     * 
+     * Rotates each left child up until the node has none, and then
+     * destructs it, so no stack is needed however deep the tree is.
+     */
+    void Clear()
+    {
+        IndexType node = m_Root;
+
+        while (node != NIL)
+        {
+            IndexType left = m_Nodes[node].left;
+
+            if (left != NIL)
+            {
+                m_Nodes[node].left = m_Nodes[left].right;
+                m_Nodes[left].right = node;
+                node = left;
+            }
+            else
+            {
+                IndexType right = m_Nodes[node].right;
+                Data(node).~Pair();
+                node = right;
+            }
+        }
+
+        m_Root = NIL;
+        m_Size = 0;
+        m_Free = NIL;
+        m_Used = 0;
+    }
+
+    /**
+     * @brief Inserts a node into the tree.
+     * @param data The data of the new node.
+     * @return Whether the key is in the tree, which it is not only
+     *         when the tree was full.
+     * 
+     * A node with the same key is kept as it is.
+     */
+    bool Insert(ConstReference data) { return Emplace(data); }
+    bool Insert(Pair&& data) { return Emplace( std::move(data) ); }
+
+    /**
+     * @brief Removes a node from the tree.
+     * @param key The key of the node to remove.
+     * @return Whether there was a node to remove.
+     * 
+     * A node with two children is replaced by the smallest node of its
+     * right subtree, which is relinked rather than copied.
+     */
+    bool Erase(const KeyType& key)
+    {
+        IndexType* link = &m_Root;
+
+        while ( *link != NIL && ( key < Data(*link).first || key > Data(*link).first ) )
+            link = key < Data(*link).first ? &m_Nodes[*link].left : &m_Nodes[*link].right;
+
+        IndexType node = *link;
+        if (node == NIL) return false;
+
+        StaticNode& erased = m_Nodes[node];
+
+        if (erased.left == NIL) *link = erased.right;
+        else if (erased.right == NIL) *link = erased.left;
+        else
+        {
+            // unlink the successor, then put it in the node's place
+            IndexType* successorLink = &erased.right;
+            while (m_Nodes[*successorLink].left != NIL)
+                successorLink = &m_Nodes[*successorLink].left;
+
+            IndexType successor = *successorLink;
+            *successorLink = m_Nodes[successor].right;
+
+            m_Nodes[successor].left = erased.left;
+            m_Nodes[successor].right = erased.right;
+            *link = successor;
+        }
+
+        Release(node);
+        return true;
+    }
+
+    /**
+     * @brief Level by level traversal.
+     * @param out The stream to print the tree out.
+     * 
+     * Outputs the nodes in each level of the tree, on a line each.
+     */
+    void LevelByLevel(std::ostream& out = std::cout) const
+    {
+        SizeType last = 0;
+
+        ForEachLevel( [&](IndexType node, SizeType level)
+        {
+            if (level != last) out << '\n';
+            last = level;
+            out << Data(node).second << ' ';
+        } );
+
+        if (m_Root != NIL) out << '\n';
+    }
+
+private:
+    // get the data of a node
+    Pair& Data(IndexType node) { return *reinterpret_cast<Pair*>(m_Nodes[node].data); }
+    const Pair& Data(IndexType node) const { return *reinterpret_cast<const Pair*>(m_Nodes[node].data); }
+
+    /**
+     * @brief Inserts a node into the tree.
+     * @param data The data of the new node.
+     * @return Whether the key is in the tree.
+     * 
+     * Finds the empty link the node belongs in, and takes a free node.
+     */
+    template<typename NewPair>
+    bool Emplace(NewPair&& data)
+    {
+        IndexType* link = &m_Root;
+
+        while (*link != NIL)
+        {
+            if (data.first < Data(*link).first) link = &m_Nodes[*link].left;
+            else if (data.first > Data(*link).first) link = &m_Nodes[*link].right;
+            else return true;
+        }
+
+        IndexType node = Allocate();
+        if (node == NIL) return false;
+
+        new ( m_Nodes[node].data ) Pair( std::forward<NewPair>(data) );
+        m_Nodes[node].left = NIL;
+        m_Nodes[node].right = NIL;
+        *link = node;
+        ++m_Size;
+
+        return true;
+    }
+
+    // take a free node, or NIL when the tree is full
+    IndexType Allocate()
+    {
+        if (m_Free != NIL)
+        {
+            IndexType node = m_Free;
+            m_Free = m_Nodes[node].left;
+            return node;
+        }
+
+        if (m_Used == Capacity) return NIL;
+        return static_cast<IndexType>(m_Used++);
+    }
+
+    /**
+     * @brief Frees an unlinked node.
+     * @param node The node to free.
+     * @return The data of the node.
+     * 
+     * Moves the data out, and puts the node at the front of the free list.
+     */
+    Pair Release(IndexType node)
+    {
+        Pair data = std::move( Data(node) );
+        Data(node).~Pair();
+
+        m_Nodes[node].left = m_Free;
+        m_Free = node;
+        --m_Size;
+
+        return data;
+    }
+
+    /**
+     * @brief Copies another tree.
+     * @param other The tree to copy, into this empty tree.
+     * 
+     * Copies the links of every node ever used, including the free
+     * list, and then copies the data of the nodes in the tree.
+     */
+    void CopyFrom(const StaticBinarySearchTree& other)
+    {
+        for (SizeType i = 0; i < other.m_Used; ++i)
+        {
+            m_Nodes[i].left = other.m_Nodes[i].left;
+            m_Nodes[i].right = other.m_Nodes[i].right;
+        }
+
+        CopyData(other, other.m_Root);
+        m_Root = other.m_Root;
+        m_Size = other.m_Size;
+        m_Free = other.m_Free;
+        m_Used = other.m_Used;
+    }
+
+    /**
+     * @brief Copies the data of a tree's nodes into the same nodes.
+     * @param other The tree to copy from.
+     * @param root The root of the other tree.
+     * 
+     * Keeps the nodes left to copy on a stack of Capacity indices,
+     * which every node is pushed onto once, so a degenerate tree takes
+     * no more stack than a balanced one.
+     */
+    void CopyData(const StaticBinarySearchTree& other, IndexType root)
+    {
+        IndexType stack[Capacity];
+        SizeType size = 0;
+        if (root != NIL) stack[size++] = root;
+
+        while (size > 0)
+        {
+            IndexType node = stack[--size];
+            new ( m_Nodes[node].data ) Pair( other.Data(node) );
+
+            if (other.m_Nodes[node].left != NIL) stack[size++] = other.m_Nodes[node].left;
+            if (other.m_Nodes[node].right != NIL) stack[size++] = other.m_Nodes[node].right;
+        }
+    }
+
+    IndexType Find(const KeyType& key, IndexType node) const
+    {
+        while (node != NIL)
+        {
+            if (key < Data(node).first) node = m_Nodes[node].left;
+            else if (key > Data(node).first) node = m_Nodes[node].right;
+            else break;
+        }
+
+        return node;
+    }
+
+    IndexType Min(IndexType node) const
+    {
+        while (m_Nodes[node].left != NIL) node = m_Nodes[node].left;
+        return node;
+    }
+
+    IndexType Max(IndexType node) const
+    {
+        while (m_Nodes[node].right != NIL) node = m_Nodes[node].right;
+        return node;
+    }
+
+    /**
+     * @brief Visits the nodes level by level.
+     * @param visit Called with each node and its depth, from the root
+     *              down, and from left to right within a level.
+     * @return The number of levels of the tree.
+     * 
+     * Keeps the nodes in a queue of Capacity indices, which every node
+     * is queued in once, so the walk takes O(n) time without recursing
+     * or allocating.
+     */
+    template<typename Function>
+    SizeType ForEachLevel(Function visit) const
+    {
+        IndexType queue[Capacity];
+        SizeType head = 0;
+        SizeType tail = 0;
+        SizeType levels = 0;
+        if (m_Root != NIL) queue[tail++] = m_Root;
+
+        while (head < tail)
+        {
+            // the nodes queued so far make up the next level
+            for (SizeType end = tail; head < end; ++head)
+            {
+                IndexType node = queue[head];
+                visit(node, levels);
+
+                if (m_Nodes[node].left != NIL) queue[tail++] = m_Nodes[node].left;
+                if (m_Nodes[node].right != NIL) queue[tail++] = m_Nodes[node].right;
+            }
+
+            ++levels;
+        }
+
+        return levels;
+    }
+};
@@ -0,0 +1,87 @@
+// This checks that a tree copied in the middle of a cursor pass keeps
+// its contents while the cursor goes on changing the original. The
+// cursor has already stepped onto nodes that the copy now shares, so
+// they must be copied again before it changes them.
+//
+// Build and run from this directory:
+//
+//     g++ -O2 -std=c++17 -pthread -I.. cursor_copy.cpp -o cursor_copy
+//     ./cursor_copy
+
+#include <cstdint>
+#include <cstdio>
+#include <vector>
+
+#include "binary_search_tree.hpp"
+
+using Tree = BinarySearchTree<std::uint64_t, std::uint64_t, void, BST_SHARED_NODES>;
+
+// the keys and values of a tree, in order
+static std::vector<std::uint64_t> Contents(const Tree& tree)
+{
+    std::vector<std::uint64_t> contents;
+    tree.ForEach( [&](const Tree::Pair& data)
+    {
+        contents.push_back(data.first);
+        contents.push_back(data.second);
+    } );
+
+    return contents;
+}
+
+// check that a tree holds the expected keys and values
+static bool Check(const char* name, const Tree& tree, const std::vector<std::uint64_t>& expected)
+{
+    std::vector<std::uint64_t> contents = Contents(tree);
+    bool valid = contents == expected && tree.Size() == expected.size() / 2;
+
+    if (!valid) std::fprintf(stderr, "%s is wrong: size %zu, %zu nodes visited\n", name, tree.Size(), contents.size() / 2);
+    return valid;
+}
+
+int main()
+{
+    Tree tree;
+    for (std::uint64_t key : {40, 20, 60, 10, 30, 50, 70})
+        tree.Insert({key, key});
+
+    std::vector<std::uint64_t> before = Contents(tree);
+    bool valid = true;
+
+    // copy right after the cursor steps onto the minimum
+    {
+        Tree original(tree);
+        Tree::Cursor cursor = original.CursorAtMin();
+        Tree copy(original);
+
+        cursor.Value() = 999;
+        cursor.EraseHere();
+
+        valid &= Check("copy at the minimum", copy, before);
+        valid &= copy.Min().first == 10 && copy.Contains(10);
+        valid &= original.Size() == 6 && !original.Contains(10) && original.Min().first == 20;
+    }
+
+    // copy halfway through a pass that erases and inserts
+    {
+        Tree original(tree);
+        Tree::Cursor cursor = original.CursorAtMin();
+        cursor.Next();
+        cursor.Next();
+
+        Tree copy(original);
+        while ( cursor.Valid() )
+        {
+            cursor.Value() += 1;
+            cursor.InsertAfter( {cursor.Data().first + 1, 0} );
+            cursor.Next();
+            if ( cursor.Valid() ) cursor.EraseHere();
+        }
+
+        valid &= Check("copy in the middle of a pass", copy, before);
+        valid &= Check( "original", original, {10, 10, 20, 20, 30, 31, 31, 0, 50, 51, 51, 0, 70, 71, 71, 0} );
+    }
+
+    std::printf( "%s\n", valid ? "copies kept their contents" : "copies were changed" );
+    return valid ? 0 : 1;
+}
@@ -0,0 +1,77 @@
+// This checks that erasing the minimum or maximum of a tree in lazy
+// erase mode is recorded as one erase, both in the trace and in the
+// latency statistics. Such an erase removes the node for real, and
+// must not be counted again by the removal it uses.
+//
+// Build and run from this directory:
+//
+//     g++ -O2 -std=c++17 -pthread -I.. trace_erase_count.cpp -o trace_erase_count
+//     ./trace_erase_count
+
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <string>
+
+#include "binary_search_tree.hpp"
+#include "trace_recorder.hpp"
+
+using Tree = BinarySearchTree<std::uint64_t, std::uint64_t, void, BST_LAZY_ERASE>;
+using Record = TraceRecord<std::uint64_t>;
+
+// the number of erases in a trace
+static std::size_t CountErases(const std::string& path)
+{
+    TraceReader<std::uint64_t> reader(path);
+    std::size_t erases = 0;
+
+    Record record;
+    while ( reader.Next(record) )
+    {
+        if ( record.operation == static_cast<std::uint8_t>(Tree::Operation::Erase) ) ++erases;
+    }
+
+    return erases;
+}
+
+int main()
+{
+    const std::string path = "trace_erase_count.bsttrace";
+
+    Tree tree;
+    for (std::uint64_t key : {50, 30, 70, 20, 40, 60, 80})
+        tree.Insert({key, key});
+
+    tree.SetLazyErase(16);
+    tree.EnableStats();
+
+    {
+        std::shared_ptr< TraceRecorder<std::uint64_t> > recorder =
+            std::make_shared< TraceRecorder<std::uint64_t> >(path);
+
+        if ( !recorder->IsOpen() )
+        {
+            std::fprintf(stderr, "could not create %s\n", path.c_str());
+            return 1;
+        }
+
+        tree.EnableTracing(recorder);
+        tree.Erase(20);
+        tree.Erase(80);
+        tree.EnableTracing(nullptr);
+    }
+
+    std::size_t traced = CountErases(path);
+    std::remove( path.c_str() );
+
+    std::uint64_t timed = tree.Stats()->latency[ static_cast<std::size_t>(Tree::Operation::Erase) ].Count();
+
+    std::printf("erases traced %zu, timed %llu\n", traced, static_cast<unsigned long long>(timed));
+    if (traced != 2 || timed != 2)
+    {
+        std::fprintf(stderr, "expected 2 erases of the minimum and maximum\n");
+        return 1;
+    }
+
+    return 0;
+}
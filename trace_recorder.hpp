@@ -0,0 +1,364 @@
+// This records the operations made on a tree to a binary trace file,
+// so that real access patterns can be replayed offline. Operations
+// are pushed into a lock-free ring, and a background thread encodes
+// and writes them. A push never waits: when the writer falls behind,
+// records are dropped and the trace says how many.
+//
+// A trace starts with a header:
+//
+//     char     magic[8]             "BSTTRACE"
+//     uint32   version              1
+//     uint32   key size             0 for variable length keys
+//     double   ticks per nanosecond
+//
+// Each record follows as an operation byte, the ticks since the last
+// record as a zigzag varint, the key, and the size of the value as a
+// varint. Fixed size keys are written as raw bytes, and strings as a
+// varint length and their characters. A record with the operation
+// byte TRACE_DROPPED only holds the number of records dropped, as a
+// varint. Everything is in the byte order of the recording machine.
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+#include "latency_histogram.hpp"
+#include "sample_ring.hpp"
+
+static constexpr std::uint32_t TRACE_VERSION = 1;
+static constexpr std::uint8_t TRACE_DROPPED = 0xff;
+
+// an operation in a trace
+template<typename KeyType>
+struct TraceRecord
+{
+    KeyType key;
+
+    // the time of the operation, in ticks since the trace started
+    std::uint64_t ticks;
+    std::uint32_t valueSize;
+
+    // the tree's Operation, as a number
+    std::uint8_t operation;
+};
+
+// put a number into a buffer, seven bits at a time
+inline void PutTraceVarint(std::vector<unsigned char>& buffer, std::uint64_t value)
+{
+    while (value >= 0x80)
+    {
+        buffer.push_back( static_cast<unsigned char>(value | 0x80) );
+        value >>= 7;
+    }
+    buffer.push_back( static_cast<unsigned char>(value) );
+}
+
+// get a number put by PutTraceVarint
+inline bool GetTraceVarint(std::FILE* file, std::uint64_t& value)
+{
+    value = 0;
+
+    for (unsigned shift = 0; shift < 64; shift += 7)
+    {
+        int byte = std::fgetc(file);
+        if (byte == EOF) return false;
+
+        value |= static_cast<std::uint64_t>(byte & 0x7f) << shift;
+        if ( (byte & 0x80) == 0 ) return true;
+    }
+
+    return false;
+}
+
+// This writes and reads the keys of a trace. Keys are written as
+// their bytes, so they must be trivially copyable.
+template<typename KeyType>
+struct TraceKey
+{
+    static_assert( std::is_trivially_copyable<KeyType>::value,
+                   "traced keys must be trivially copyable, or a std::string" );
+
+    static constexpr std::uint32_t SIZE = sizeof(KeyType);
+
+    static void Put(std::vector<unsigned char>& buffer, const KeyType& key)
+    {
+        const unsigned char* bytes = reinterpret_cast<const unsigned char*>(&key);
+        buffer.insert(buffer.end(), bytes, bytes + sizeof(KeyType));
+    }
+
+    static bool Get(std::FILE* file, KeyType& key)
+    {
+        return std::fread(&key, sizeof(KeyType), 1, file) == 1;
+    }
+};
+
+template<>
+struct TraceKey<std::string>
+{
+    static constexpr std::uint32_t SIZE = 0;
+
+    static void Put(std::vector<unsigned char>& buffer, const std::string& key)
+    {
+        PutTraceVarint(buffer, key.size());
+        buffer.insert(buffer.end(), key.begin(), key.end());
+    }
+
+    static bool Get(std::FILE* file, std::string& key)
+    {
+        std::uint64_t size;
+        if ( !GetTraceVarint(file, size) ) return false;
+
+        key.resize(size);
+        return size == 0 || std::fread(&key[0], size, 1, file) == 1;
+    }
+};
+
+// get the size of a value, as it is recorded in a trace
+template<typename ValueType>
+std::uint32_t TraceValueSize(const ValueType&) { return sizeof(ValueType); }
+
+inline std::uint32_t TraceValueSize(const std::string& value) { return static_cast<std::uint32_t>( value.size() ); }
+
+template<typename KeyType>
+class TraceRecorder
+{
+public:
+    using SizeType = std::size_t;
+
+    // the bytes encoded before they are written out
+    static constexpr SizeType BUFFER_BYTES = 1 << 16;
+
+private:
+    SampleRing< TraceRecord<KeyType> > m_Records;
+    std::FILE* m_File;
+    std::uint64_t m_StartTicks;
+
+    std::atomic<bool> m_Stopping;
+    std::thread m_Writer;
+
+public:
+    /**
+     * @brief Default constructor.
+     * @param path The path of the trace file to create.
+     * @param capacity The number of records to hold until they are
+     *                 written, which is rounded up to a power of two.
+     * 
+     * Writes the header and starts the writer thread, unless the file
+     * could not be created. The key type must be default constructible.
+     */
+    explicit TraceRecorder(const std::string& path, SizeType capacity = 1 << 16)
+        : m_Records(capacity),
+          m_File( std::fopen(path.c_str(), "wb") ),
+          m_StartTicks( LatencyTicks() ),
+          m_Stopping(false)
+    {
+        if (m_File == nullptr) return;
+
+        std::uint32_t keySize = TraceKey<KeyType>::SIZE;
+        double ticksPerNanosecond = LatencyTicksPerNanosecond();
+
+        std::fwrite("BSTTRACE", 8, 1, m_File);
+        std::fwrite(&TRACE_VERSION, sizeof(TRACE_VERSION), 1, m_File);
+        std::fwrite(&keySize, sizeof(keySize), 1, m_File);
+        std::fwrite(&ticksPerNanosecond, sizeof(ticksPerNanosecond), 1, m_File);
+
+        m_Writer = std::thread(&TraceRecorder::Write, this);
+    }
+
+    TraceRecorder(const TraceRecorder&) = delete;
+    TraceRecorder& operator=(const TraceRecorder&) = delete;
+
+    // write out the remaining records, and close the file
+    ~TraceRecorder()
+    {
+        if (m_File == nullptr) return;
+
+        m_Stopping.store(true, std::memory_order_release);
+        m_Writer.join();
+        std::fclose(m_File);
+    }
+
+    // get whether the trace file could be created
+    bool IsOpen() const { return m_File != nullptr; }
+
+    // get the number of records that did not fit
+    SizeType Dropped() const { return m_Records.Dropped(); }
+
+    /**
+     * @brief Records an operation.
+     * @param operation The operation, as a number.
+     * @param key The key of the operation.
+     * @param valueSize The size of the value that was inserted.
+     * 
+     * Timestamps the operation and pushes it for the writer thread.
+     */
+    void Record(std::uint8_t operation, const KeyType& key, std::uint32_t valueSize = 0)
+    {
+        if (m_File == nullptr) return;
+
+        m_Records.TryPush( TraceRecord<KeyType>{ key, LatencyTicks(), valueSize, operation } );
+    }
+
+private:
+    /**
+     * @brief Writes records until the recorder is destroyed.
+     * 
+     * Drains the ring into a buffer, which is written out whenever it
+     * fills, and sleeps while the ring is empty. Dropped records are
+     * noted as they are seen, and once more at the end.
+     */
+    void Write()
+    {
+        std::vector<unsigned char> buffer;
+        buffer.reserve(BUFFER_BYTES + 64);
+
+        TraceRecord<KeyType> record;
+        std::uint64_t lastTicks = m_StartTicks;
+        SizeType noted = 0;
+
+        while (1)
+        {
+            bool stopping = m_Stopping.load(std::memory_order_acquire);
+
+            while ( m_Records.TryPop(record) )
+            {
+                // records are pushed by many threads, so time can go back
+                std::int64_t delta = static_cast<std::int64_t>(record.ticks - lastTicks);
+                lastTicks = record.ticks;
+
+                buffer.push_back(record.operation);
+                PutTraceVarint( buffer, (static_cast<std::uint64_t>(delta) << 1) ^ static_cast<std::uint64_t>(delta >> 63) );
+                TraceKey<KeyType>::Put(buffer, record.key);
+                PutTraceVarint(buffer, record.valueSize);
+
+                if ( !(buffer.size() < BUFFER_BYTES) ) Flush(buffer);
+            }
+
+            SizeType dropped = m_Records.Dropped();
+            if (dropped != noted)
+            {
+                buffer.push_back(TRACE_DROPPED);
+                PutTraceVarint(buffer, dropped - noted);
+                noted = dropped;
+            }
+
+            if (stopping) break;
+            std::this_thread::sleep_for( std::chrono::milliseconds(1) );
+        }
+
+        Flush(buffer);
+    }
+
+    // write out and empty a buffer
+    void Flush(std::vector<unsigned char>& buffer)
+    {
+        if ( !buffer.empty() ) std::fwrite(buffer.data(), buffer.size(), 1, m_File);
+        buffer.clear();
+    }
+};
+
+template<typename KeyType>
+class TraceReader
+{
+public:
+    using SizeType = std::size_t;
+
+private:
+    std::FILE* m_File;
+    double m_TicksPerNanosecond;
+    std::uint64_t m_Ticks;
+    std::uint64_t m_Dropped;
+
+public:
+    /**
+     * @brief Default constructor.
+     * @param path The path of the trace file to read.
+     * 
+     * Opens the trace, and checks that its header matches the key type.
+     */
+    explicit TraceReader(const std::string& path)
+        : m_File( std::fopen(path.c_str(), "rb") ),
+          m_TicksPerNanosecond(1),
+          m_Ticks(0),
+          m_Dropped(0)
+    {
+        if (m_File == nullptr) return;
+
+        char magic[8];
+        std::uint32_t version = 0;
+        std::uint32_t keySize = 0;
+
+        bool valid = std::fread(magic, 8, 1, m_File) == 1 &&
+                     std::memcmp(magic, "BSTTRACE", 8) == 0 &&
+                     std::fread(&version, sizeof(version), 1, m_File) == 1 &&
+                     std::fread(&keySize, sizeof(keySize), 1, m_File) == 1 &&
+                     std::fread(&m_TicksPerNanosecond, sizeof(m_TicksPerNanosecond), 1, m_File) == 1 &&
+                     version == TRACE_VERSION && keySize == TraceKey<KeyType>::SIZE;
+
+        if (!valid)
+        {
+            std::fclose(m_File);
+            m_File = nullptr;
+        }
+    }
+
+    TraceReader(const TraceReader&) = delete;
+    TraceReader& operator=(const TraceReader&) = delete;
+
+    ~TraceReader() { if (m_File) std::fclose(m_File); }
+
+    // get whether the trace was opened, and matches the key type
+    bool IsOpen() const { return m_File != nullptr; }
+
+    double TicksPerNanosecond() const { return m_TicksPerNanosecond; }
+
+    // get the number of records dropped so far by the recorder
+    std::uint64_t Dropped() const { return m_Dropped; }
+
+    /**
+     * @brief Reads the next record.
+     * @param record Where to put the record.
+     * @return Whether there was a whole record.
+     * 
+     * Counts the dropped records noted on the way.
+     */
+    bool Next(TraceRecord<KeyType>& record)
+    {
+        if (m_File == nullptr) return false;
+
+        while (1)
+        {
+            int operation = std::fgetc(m_File);
+            if (operation == EOF) return false;
+
+            std::uint64_t value;
+            if ( !GetTraceVarint(m_File, value) ) return false;
+
+            if (operation == TRACE_DROPPED)
+            {
+                m_Dropped += value;
+                continue;
+            }
+
+            // undo the zigzag encoding of the time since the last record
+            m_Ticks += (value >> 1) ^ (~(value & 1) + 1);
+
+            std::uint64_t valueSize;
+            if ( !TraceKey<KeyType>::Get(m_File, record.key) || !GetTraceVarint(m_File, valueSize) )
+                return false;
+
+            record.ticks = m_Ticks;
+            record.valueSize = static_cast<std::uint32_t>(valueSize);
+            record.operation = static_cast<std::uint8_t>(operation);
+            return true;
+        }
+    }
+};